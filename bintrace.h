@@ -0,0 +1,66 @@
+/*
+ * bintrace.h - binary trace file format
+ *
+ * A binary trace holds the same requests as a .rep file, laid out so
+ * that the driver can mmap it and replay the ops in place:
+ *
+ *   bt_header_t                  at offset 0
+ *   bt_op_t[num_ops]             at ops_offset
+ *   bt_index_t[num_ops / stride] at index_offset, if BT_HAS_INDEX is set
+ *
+ * All fields are little-endian. An op is three 32-bit words: the first
+ * holds the type in its low 3 bits and the block index (-1 for free(NULL))
+ * as a signed number in the upper 29 bits, the second is the size and
+ * the third the alignment of a MEMALIGN request (0 for the others).
+ * A CALLOC op asks for size zeroed bytes, as calloc(1, size).
+ * This is the layout gcc gives the bit-fields of bt_op_t on x86, so the
+ * driver uses it as its in-memory traceop_t as well.
+ *
+ * The optional index has one entry every index_stride ops, with the
+ * live payload bytes and blocks before that op, so tools can seek into
+ * or summarize a trace without replaying it from the start.
+ */
+#ifndef __BINTRACE_H_
+#define __BINTRACE_H_
+
+#include <stdint.h>
+
+#define BT_MAGIC      "MMTRACE2" /* the last byte is BT_VERSION */
+#define BT_MAGIC_LEN  8
+#define BT_VERSION    2
+
+#define BT_HAS_INDEX  0x1      /* header flag: index present */
+
+#define BT_MAX_INDEX  ((1 << 28) - 1) /* largest block index of an op */
+
+/* Request types, as stored in bt_op_t.type */
+enum { ALLOC, FREE, REALLOC, MEMALIGN, CALLOC, BT_NUM_TYPES };
+
+typedef struct {
+	char magic[BT_MAGIC_LEN];  /* BT_MAGIC */
+	uint32_t version;          /* BT_VERSION */
+	uint32_t flags;            /* BT_HAS_INDEX */
+	int32_t weight;            /* same four fields as the .rep header */
+	int32_t num_ids;
+	int32_t num_ops;
+	int32_t ignore_ranges;
+	uint64_t ops_offset;       /* file offset of the op stream */
+	uint64_t index_offset;     /* file offset of the index, 0 if none */
+	uint32_t index_stride;     /* ops between two index entries */
+	uint32_t index_entries;    /* number of index entries */
+} bt_header_t;
+
+typedef struct {
+	unsigned int type : 3;     /* ALLOC, FREE, REALLOC, MEMALIGN or CALLOC */
+	int index : 29;            /* block index, -1 for free(NULL) */
+	uint32_t size;             /* byte size of alloc/realloc/calloc request */
+	uint32_t align;            /* power of two alignment of a MEMALIGN */
+} bt_op_t;
+
+typedef struct {
+	uint64_t live_bytes;       /* payload bytes allocated before the op */
+	uint32_t live_blocks;      /* blocks allocated before the op */
+	uint32_t pad;
+} bt_index_t;
+
+#endif /* __BINTRACE_H_ */
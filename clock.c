@@ -72,6 +72,15 @@ double get_counter()
 }
 /* $end x86cyclecounter */
 
+/* Return the cycle counter, serialized so that it is not read before
+   the preceding instructions have finished */
+unsigned long long read_counter()
+{
+    unsigned hi, lo;
+    asm volatile("lfence; rdtsc" : "=d" (hi), "=a" (lo) : : "memory");
+    return ((unsigned long long)hi << 32) | lo;
+}
+
 #elif defined(__alpha)
 
 /****************************************************
@@ -134,6 +143,11 @@ double get_counter()
     return result;
 }
 
+unsigned long long read_counter()
+{
+    return counter();
+}
+
 #else
 
 /****************************************************************
@@ -159,6 +173,14 @@ double get_counter()
     printf("Please choose another timing package in config.h.\n");
     exit(1);
 }
+
+unsigned long long read_counter()
+{
+    printf("ERROR: You are trying to use a read_counter routine in clock.c\n");
+    printf("that has not been implemented yet on this platform.\n");
+    printf("Please choose another timing package in config.h.\n");
+    exit(1);
+}
 #endif
 
 
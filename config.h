@@ -91,9 +91,21 @@
 #define ALIGNMENT 8
 
 /*
- * Maximum heap size in bytes
+ * Maximum heap size in bytes. memlib reserves this much address space
+ * and commits it as the heap grows; huge blocks count against it too.
+ * Set it with make MAX_HEAP=<bytes>. mm.c keeps 32 bit sizes and free
+ * list offsets unless built with -DMM_WIDE, so only the wide build may
+ * go past 4 GB.
  */
-#define MAX_HEAP (100*(1<<20))  /* 100 MB */
+#ifndef MAX_HEAP
+#if !defined(MM_PRELOAD)
+#define MAX_HEAP (100*(1UL<<20))  /* 100 MB */
+#elif defined(MM_WIDE)
+#define MAX_HEAP (1UL<<38)  /* 256 GB */
+#else
+#define MAX_HEAP (1UL<<31)  /* 2 GB */
+#endif
+#endif
 
 /*****************************************************************************
  * Set exactly one of these USE_xxx constants to "1" to select a timing method
@@ -10,6 +10,7 @@
 #include <assert.h>
 #include <errno.h>
 #include <float.h>
+#include <math.h>
 #include <setjmp.h>
 #include <signal.h>
 #include <stdarg.h>
@@ -18,13 +19,21 @@
 #include <string.h>
 #include <time.h>
 #include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
 
 
 #include "mm.h"
 #include "memlib.h"
 #include "fsecs.h"
+#include "clock.h"
 #include "config.h"
 #include "driverlib.h"
+#include "bintrace.h"
+#include "replay.h"
+#include "perfctr.h"
 
 /**********************
  * Constants and macros
@@ -38,6 +47,9 @@
 #define HDRLINES       4 /* number of header lines in a trace file */
 #define LINENUM(i) (i+5) /* cnvt trace request nums to linenums (origin 1) */
 
+/* Latency histograms kept per request type, then one of all requests */
+#define LAT_ALL BT_NUM_TYPES
+
 /* Returns true if p is ALIGNMENT-byte aligned */
 #define IS_ALIGNED(p)  ((((unsigned long)(p)) % ALIGNMENT) == 0)
 
@@ -52,29 +64,42 @@
  * Remember that index (-1) is the null pointer.
  */
 
-/* Records the extent of each block's payload */
+/*
+ * Records the extent of each block's payload. The ranges form a treap
+ * ordered by lo (a max-heap on prio), and since the payloads never
+ * overlap, the ranges just below and just above a new block are the
+ * only ones that can overlap it.
+ */
 typedef struct range_t {
 	char *lo;              /* low payload address */
 	char *hi;              /* high payload address */
-	struct range_t *next;  /* next list element */
+	struct range_t *left;  /* ranges below lo */
+	struct range_t *right; /* ranges above hi; next free node in the pool */
+	unsigned int prio;     /* random treap priority */
 	int index;             /* same index as free; for debugging */
 } range_t;
 
-/* Characterizes a single trace operation (allocator request) */
-typedef struct {
-	enum { ALLOC, FREE, REALLOC } type; /* type of request */
-	int index;                        /* index for free() to use later */
-	size_t size;                      /* byte size of alloc/realloc request */
-} traceop_t;
+/* Range nodes are carved from chunks of this many, never from malloc */
+#define RANGE_CHUNK 4096
+
+/*
+ * Characterizes a single trace operation (allocator request): its type
+ * (ALLOC, FREE, REALLOC, MEMALIGN, CALLOC), the index for free() to use
+ * later, the byte size of the request and the alignment of a memalign. The layout is the op record of binary
+ * traces, so those are replayed straight from the mapped file.
+ */
+typedef bt_op_t traceop_t;
 
 /* Holds the information for one trace file*/
 typedef struct {
 	char filename[MAXLINE];
-	int ignore_ranges;   /* don't check ranges (i.e. this is too big) */
+	int ignore_ranges;   /* 1: skip the payload overlap check */
 	int num_ids;         /* number of alloc/realloc ids */
 	int num_ops;         /* number of distinct requests */
 	int weight;          /* weight for this trace (unused) */
 	traceop_t *ops;      /* array of requests */
+	void *map;           /* mapping of a binary trace file, ops point into it */
+	size_t map_len;      /* length of that mapping */
 	char **blocks;       /* array of ptrs returned by malloc/realloc... */
 	size_t *block_sizes; /* ... and a corresponding array of payload sizes */
 	int *block_rand_base;/* index into random_data, if debug is on */
@@ -88,14 +113,32 @@ typedef struct {
 typedef struct {
 	trace_t *trace;
 	range_t *ranges;
+	replay_t *replay;  /* the trace compiled for the timed runs */
 } speed_t;
 
+/*
+ * Log-bucketed (HDR-style) histogram of request latencies in cycles.
+ * Values below HIST_SUB get a bucket each, every power of two above
+ * is split into HIST_SUB buckets, so a bucket is within 1/HIST_SUB of
+ * the values in it.
+ */
+#define HIST_SUB_BITS 4
+#define HIST_SUB      (1 << HIST_SUB_BITS)
+#define HIST_BUCKETS  ((64 - HIST_SUB_BITS + 1) * HIST_SUB)
+typedef struct {
+	unsigned long long count[HIST_BUCKETS];
+	unsigned long long n;     /* number of values recorded */
+	unsigned long long max;   /* largest value recorded */
+} hist_t;
+
+#define MAX_TRIALS 64 /* most timed runs of a trace (-n) */
+
 /* Summarizes the important stats for some malloc function on some trace */
 typedef struct {
 	/* set in read_trace */
 	char filename[MAXLINE];
 	int weight;
-	double ops;      /* number of ops (malloc/free/realloc) in the trace */
+	double ops;      /* number of ops (malloc/free/realloc/memalign/calloc) in the trace */
 
 	/* run-time stats defined for both libc and student */
 	int valid;       /* was the trace processed correctly by the allocator? */
@@ -103,6 +146,27 @@ typedef struct {
 
 	/* defined only for the student malloc package */
 	double util;     /* space utilization for this trace (always 0 for libc) */
+	hist_t *lat;     /* latency of each request type and of all, lat[LAT_ALL] (-L) */
+	mm_stats_t *mm;  /* allocator counters of the util run (-M) */
+	size_t heap_peak;  /* heap bytes at most during the trace (-R)... */
+	size_t heap_end;   /* ... and at its end, */
+	size_t rss_end;    /* resident heap bytes at its end, */
+	size_t heap_trim;  /* heap bytes after mm_trim(0), */
+	size_t rss_trim;   /* resident heap bytes after mm_trim(0) */
+	long faults;       /* page faults of a run on a heap with no resident pages (-F), */
+	double cold_cpo;   /* its cycles per op, */
+	double warm_cpo;   /* cycles per op of a second run on the same pages, */
+	size_t thp;        /* heap bytes in transparent huge pages after it */
+	double null_secs;  /* secs to replay the trace against a null allocator (-O) */
+	double perf[PERF_MAX]; /* counts per op of a run under the counters of -P */
+	int frag_samples;    /* samples of the free blocks taken (-G), */
+	size_t frag_peak;    /* the largest heap they saw, */
+	double frag_peak_op; /* the op it was first seen after, */
+	double frag_peak_util; /* live bytes over heap bytes then, */
+	double frag_max_ext; /* most of the free bytes outside the largest free block, */
+	double frag_ext_op;  /* and the op it was seen after */
+	int ntrials;         /* timed runs of the trace (-n), secs is their median... */
+	double trial_secs[MAX_TRIALS]; /* ... and these their secs */
 
 	/* Note: secs and util are only defined if valid is true */
 } stats_t;
@@ -131,6 +195,23 @@ static enum { DBG_NONE, DBG_CHEAP, DBG_EXPENSIVE } debug_mode = DBG_CHEAP;
 int verbose = 1;        /* global flag for verbose output */
 static int errors = 0;  /* number of errs found when running student malloc */
 int onetime_flag = 0;
+static int latency_flag = 0; /* measure the latency of every request (-L) */
+static int worst_flag = 0;   /* print the worst latency of each request type (-w) */
+static int mmstats_flag = 0; /* print the allocator counters (-M) */
+static int own_heap_flag = 0; /* check each trace in a heap of its own too (-E) */
+static int heap_flag = 0;    /* report heap size and RSS after each trace (-R) */
+static int fault_flag = 0;   /* report page faults and cycles per op (-F) */
+static int thp_flag = 0;     /* back the heap with transparent huge pages (-T) */
+static int overhead_flag = 0; /* time the replay loop alone (-O) */
+static size_t touch_bytes = 0; /* bytes of each payload the timed runs touch (-W) */
+static int perf_flag = 0;    /* count events with perf_event_open (-P) */
+static perf_t perf;          /* the counters that could be opened for -P */
+static unsigned long frag_interval = 0; /* ops between samples of the free blocks (-G) */
+static int frag_json = 0;    /* write the samples as JSON, not CSV */
+static int trials = 0;       /* timed runs of each trace, 1 or 5 with -b if not set by -n */
+static char *results_file = NULL;  /* write the results as JSON or CSV (-o) */
+static char *baseline_file = NULL; /* compare them with these saved results (-b) */
+static double regress_pct = 5;     /* slowdown or util loss that fails the comparison (-x) */
 
 /* by default, no timeouts */
 static int set_timeout = 0;
@@ -151,11 +232,12 @@ char autoresult[SUBMITR_MAXBUF]; /* autoresult string */
  * Function prototypes
  *********************/
 
-/* these functions manipulate range lists */
+/* these functions manipulate range trees */
 static int add_range(range_t **ranges, char *lo, int size,
 		const trace_t *trace, int opnum, int index);
 static void remove_range(range_t **ranges, char *lo);
 static void clear_ranges(range_t **ranges);
+static void check_ranges(const range_t *ranges, const trace_t *trace, int opnum);
 
 /* These functions implement the debugging code */
 static void init_random_data(void);
@@ -166,7 +248,10 @@ static void randomize_block(trace_t *trace, int index);
 static trace_t *read_trace(stats_t *stats, const char *tracedir,
 		const char *filename);
 static trace_t *read_trace_stdin(stats_t *stats);
+static void read_bintrace(trace_t *trace, int fd, FILE *stream);
+static void alloc_trace_blocks(trace_t *trace);
 static void reinit_trace(trace_t *trace);
+static replay_t *compile_trace(trace_t *trace);
 static void free_trace(trace_t *trace);
 
 /* Routines for evaluating the correctness and speed of libc malloc */
@@ -176,11 +261,36 @@ static void eval_libc_speed(void *ptr);
 /* Routines for evaluating correctnes, space utilization, and speed
    of the student's malloc package in mm.c */
 static int eval_mm_valid(trace_t *trace, range_t **ranges);
+static int eval_heap_valid(trace_t *trace, range_t **ranges);
 static double eval_mm_util(trace_t *trace, int tracenum);
 static void eval_mm_speed(void *ptr);
+static void eval_mm_latency(trace_t *trace, stats_t *stats);
+static void eval_mm_heap(trace_t *trace, stats_t *stats);
+static void eval_mm_faults(speed_t *speed_params, stats_t *stats);
+static void eval_mm_frag(trace_t *trace, stats_t *stats);
+static void eval_null_speed(void *ptr);
+static void eval_mm_perf(speed_t *speed_params, stats_t *stats);
+
+/* These functions build and query latency histograms */
+static void hist_add(hist_t *hist, unsigned long long value);
+static void hist_merge(hist_t *dst, const hist_t *src);
+static unsigned long long hist_percentile(const hist_t *hist, double pct);
 
 /* Various helper routines */
 static void printresults(int n, stats_t *stats);
+static void printslabgains(int n, stats_t *off, stats_t *on);
+static void printlatency(int n, stats_t *stats);
+static void printworst(int n, stats_t *stats);
+static void printmmstats(int n, stats_t *stats);
+static void printheap(int n, stats_t *stats);
+static void printfaults(int n, stats_t *stats);
+static void printoverhead(int n, stats_t *stats);
+static void printperf(int n, stats_t *stats);
+static void printfrag(int n, stats_t *stats);
+static double median(const double *values, int n);
+static void write_results(const char *path, int n, stats_t *stats,
+		double util, double ops, double secs, double perfindex);
+static int compare_results(const char *path, int n, stats_t *stats);
 static void usage(void);
 static void malloc_error(const trace_t *trace, int opnum, const char *fmt, ...)
 	__attribute__((format(printf, 3,4)));
@@ -200,7 +310,8 @@ static void app_error(const char *fmt, ...)
    num_tracefiles, if there's a timeout) */
 static void run_tests(int num_tracefiles, char trace_from_stdin,
 		const char *tracedir, char **tracefiles, 
-		stats_t *mm_stats, range_t *ranges, speed_t *speed_params) {
+		stats_t *mm_stats, stats_t *slab_on_stats,
+		range_t *ranges, speed_t *speed_params) {
 	volatile int i;
 	volatile int timed_out = 0;
 
@@ -217,6 +328,22 @@ static void run_tests(int num_tracefiles, char trace_from_stdin,
 
 		strcpy(mm_stats[i].filename, trace->filename);
 		mm_stats[i].ops = trace->num_ops;
+		speed_params->replay = compile_trace(trace);
+
+		/* With -S, run the trace with the slab engine on first */
+		if (slab_on_stats && !timed_out && !onetime_flag) {
+			slab_on_stats[i] = mm_stats[i];
+			mm_set_slab(1);
+			slab_on_stats[i].valid = eval_mm_valid(trace, &ranges);
+			if (slab_on_stats[i].valid) {
+				slab_on_stats[i].util = eval_mm_util(trace, i);
+				speed_params->trace = trace;
+				speed_params->ranges = ranges;
+				slab_on_stats[i].secs = fsecs(eval_mm_speed, speed_params);
+			}
+			mm_set_slab(0);
+		}
+
 		if(timed_out) {
 			mm_stats[i].valid = 0;
 		} else {
@@ -224,7 +351,12 @@ static void run_tests(int num_tracefiles, char trace_from_stdin,
 				printf("Checking mm_malloc for correctness, ");
 			mm_stats[i].valid = eval_mm_valid(trace, &ranges);
 
+			/* With -E, check the trace again in a heap of its own */
+			if (own_heap_flag && mm_stats[i].valid)
+				mm_stats[i].valid = eval_heap_valid(trace, &ranges);
+
 			if (onetime_flag) {
+				replay_free(speed_params->replay);
 				free_trace(trace);
 				return;
 			}
@@ -233,12 +365,38 @@ static void run_tests(int num_tracefiles, char trace_from_stdin,
 			if (verbose > 1)
 				printf("efficiency, ");
 			mm_stats[i].util = eval_mm_util(trace, i);
+			if (mmstats_flag) {
+				if ((mm_stats[i].mm = malloc(sizeof(mm_stats_t))) == NULL)
+					unix_error("malloc failed in run_tests");
+				if (mm_get_stats(mm_stats[i].mm) < 0) {
+					free(mm_stats[i].mm);
+					mm_stats[i].mm = NULL;
+				}
+			}
 			speed_params->trace = trace;
 			speed_params->ranges = ranges;
 			if (verbose > 1)
 				printf("and performance.\n");
 			mm_stats[i].secs = fsecs(eval_mm_speed, speed_params);
+			mm_stats[i].trial_secs[0] = mm_stats[i].secs;
+			for (mm_stats[i].ntrials = 1; mm_stats[i].ntrials < trials; mm_stats[i].ntrials++)
+				mm_stats[i].trial_secs[mm_stats[i].ntrials] =
+					fsecs(eval_mm_speed, speed_params);
+			mm_stats[i].secs = median(mm_stats[i].trial_secs, mm_stats[i].ntrials);
+			if (latency_flag || worst_flag)
+				eval_mm_latency(trace, &mm_stats[i]);
+			if (heap_flag)
+				eval_mm_heap(trace, &mm_stats[i]);
+			if (frag_interval)
+				eval_mm_frag(trace, &mm_stats[i]);
+			if (fault_flag)
+				eval_mm_faults(speed_params, &mm_stats[i]);
+			if (overhead_flag)
+				mm_stats[i].null_secs = fsecs(eval_null_speed, speed_params);
+			if (perf_flag)
+				eval_mm_perf(speed_params, &mm_stats[i]);
 		}
+		replay_free(speed_params->replay);
 		free_trace(trace);
 	}
 }
@@ -257,15 +415,18 @@ int main(int argc, char **argv)
 	range_t *ranges = NULL;    /* keeps track of block extents for one trace */
 	stats_t *libc_stats = NULL;/* libc stats for each trace */
 	stats_t *mm_stats = NULL;  /* mm (i.e. student) stats for each trace */
+	stats_t *slab_on_stats = NULL; /* mm stats with the slab engine on (-S) */
 	speed_t speed_params;      /* input parameters to the xx_speed routines */
 
 	int run_libc = 0;     /* If set, run libc malloc (set by -l) */
 	int autograder = 0;   /* if set then called by autograder (-A) */
+	int slab_compare = 0; /* If set, also run mm with the slab engine on (-S) */
 
 	/* temporaries used to compute the performance index */
 	double secs, ops, util, avg_mm_util, avg_mm_throughput = 0, p1, p2, perfindex;
 	double weight = 0;
 	int numcorrect;
+	int regressions = 0;  /* traces that got slower or less utilized than the baseline (-b) */
 
 
 	setbuf(stdout, 0);
@@ -277,8 +438,8 @@ int main(int argc, char **argv)
 #ifdef OJ
 		num_tracefiles = 1;
 		trace_from_stdin = 1;
-#else
-	while ((c = getopt(argc, argv, "d:f:c:s:t:v:hVAlDj")) != EOF) {
+#endif
+	while ((c = getopt(argc, argv, "d:f:c:s:t:v:hVAlDjSLwMERFOPTG:H:W:n:o:b:x:")) != EOF) {
 		switch (c) {
 
 			case 'A': /* Hidden Autolab driver argument */
@@ -287,6 +448,7 @@ int main(int argc, char **argv)
 
 			case 'f': /* Use one specific trace file only (relative to curr dir) */
 				num_tracefiles = 1;
+				trace_from_stdin = 0;
 				if ((tracefiles = realloc(tracefiles, 2 * sizeof(char *))) == NULL)
 					unix_error("ERROR: realloc failed in main");
 				strcpy(tracedir, "./");
@@ -296,6 +458,7 @@ int main(int argc, char **argv)
 
 			case 'c': /* Use one specific trace file and run only once */
 				num_tracefiles = 1;
+				trace_from_stdin = 0;
 				onetime_flag = 1;
 				if ((tracefiles = realloc(tracefiles, 2 * sizeof(char *))) == NULL)
 					unix_error("ERROR: realloc failed in main");
@@ -341,6 +504,88 @@ int main(int argc, char **argv)
 				trace_from_stdin = 1;
 				break;
 
+			case 'S': /* Report the gains of the slab engine */
+				slab_compare = 1;
+				break;
+
+			case 'L': /* Measure the latency of every request */
+				latency_flag = 1;
+				break;
+
+			case 'w': /* Report the worst-case cycles of each op type */
+				worst_flag = 1;
+				break;
+
+			case 'M': /* Print the allocator counters */
+				mmstats_flag = 1;
+				break;
+
+			case 'E': /* Check each trace in an mm_heap_create heap too */
+				own_heap_flag = 1;
+				break;
+
+			case 'R': /* Report heap size and RSS after each trace */
+				heap_flag = 1;
+				break;
+
+			case 'F': /* Report page faults and cycles per op */
+				fault_flag = 1;
+				break;
+
+			case 'G': { /* Sample the free blocks every <n> ops, as CSV or JSON */
+				char *fmt;
+				frag_interval = strtoul(optarg, &fmt, 0);
+				if (*fmt == ',')
+					fmt++;
+				if (strcmp(fmt, "json") == 0)
+					frag_json = 1;
+				else if (*fmt != '\0' && strcmp(fmt, "csv") != 0)
+					app_error("-G %s: the format is csv or json", optarg);
+				if (frag_interval == 0)
+					app_error("-G %s: sample every one op or more", optarg);
+				break;
+			}
+
+			case 'W': /* Touch payloads in the timed runs, 0 for all of them */
+				touch_bytes = strtoul(optarg, NULL, 0);
+				if (touch_bytes == 0)
+					touch_bytes = SIZE_MAX;
+				break;
+
+			case 'P': /* Count events with perf_event_open */
+				perf_flag = 1;
+				break;
+
+			case 'O': /* Time the replay loop with a null allocator */
+				overhead_flag = 1;
+				break;
+
+			case 'T': /* Back the heap with transparent huge pages */
+				thp_flag = 1;
+				break;
+
+			case 'H': /* Threshold of huge blocks, 0 for none */
+				mm_set_huge(strtoul(optarg, NULL, 0));
+				break;
+
+			case 'n': /* Time each trace this many times */
+				trials = atoi(optarg);
+				if (trials < 1 || trials > MAX_TRIALS)
+					app_error("-n %s: time a trace 1 to %d times", optarg, MAX_TRIALS);
+				break;
+
+			case 'o': /* Write the results as JSON, or CSV if the file ends in .csv */
+				results_file = optarg;
+				break;
+
+			case 'b': /* Compare with the results saved in a file by -o */
+				baseline_file = optarg;
+				break;
+
+			case 'x': /* Percent slowdown or util loss that fails -b */
+				regress_pct = atof(optarg);
+				break;
+
 			case 'h': /* Print this message */
 				usage();
 				exit(0);
@@ -350,7 +595,23 @@ int main(int argc, char **argv)
 				exit(1);
 		}
 	}
-#endif
+
+	if (trials == 0)
+		trials = baseline_file ? 5 : 1;
+
+	if (perf_flag) {
+		if (perf_open(&perf) == 0) {
+			printf("No performance counters could be opened, ignoring -P\n");
+			perf_flag = 0;
+		}
+		perf_close(&perf);
+	}
+
+	if (touch_bytes == SIZE_MAX)
+		printf("Timed runs write and read back every payload\n");
+	else if (touch_bytes)
+		printf("Timed runs write and read back the first %zu bytes of each payload\n",
+				touch_bytes);
 
 	if (trace_from_stdin) {
 		printf("Using stdin as tracefile\n");
@@ -398,9 +659,11 @@ int main(int argc, char **argv)
 			libc_stats[i].valid = eval_libc_valid(trace);
 			if (libc_stats[i].valid) {
 				speed_params.trace = trace;
+				speed_params.replay = compile_trace(trace);
 				if (verbose > 1)
 					printf("and performance.\n");
 				libc_stats[i].secs = fsecs(eval_libc_speed, &speed_params);
+				replay_free(speed_params.replay);
 			}
 			free_trace(trace);
 		}
@@ -423,11 +686,18 @@ int main(int argc, char **argv)
 	if (mm_stats == NULL)
 		unix_error("mm_stats calloc in main failed");
 
+	if (slab_compare) {
+		slab_on_stats = (stats_t *)calloc(num_tracefiles, sizeof(stats_t));
+		if (slab_on_stats == NULL)
+			unix_error("slab_on_stats calloc in main failed");
+	}
+
 	/* Initialize the simulated memory system in memlib.c */
+	mem_set_thp(thp_flag);
 	mem_init();
 
 	run_tests(num_tracefiles, trace_from_stdin, tracedir, tracefiles,
-			mm_stats, ranges, &speed_params);
+			mm_stats, slab_on_stats, ranges, &speed_params);
 
 
 	/* Display the mm results in a compact table */
@@ -443,6 +713,50 @@ int main(int argc, char **argv)
 			printf("\nResults for mm malloc:\n");
 			printresults(num_tracefiles, mm_stats);
 			printf("\n");
+			if (latency_flag) {
+				printf("Latency per request type (cycles):\n");
+				printlatency(num_tracefiles, mm_stats);
+				printf("\n");
+			}
+			if (worst_flag) {
+				printf("Worst-case cycles per op:\n");
+				printworst(num_tracefiles, mm_stats);
+				printf("\n");
+			}
+			if (slab_compare) {
+				printf("Slab engine gains (off -> on):\n");
+				printslabgains(num_tracefiles, mm_stats, slab_on_stats);
+				printf("\n");
+			}
+			if (mmstats_flag)
+				printmmstats(num_tracefiles, mm_stats);
+			if (heap_flag) {
+				printf("Heap size and resident bytes (KB):\n");
+				printheap(num_tracefiles, mm_stats);
+				printf("\n");
+			}
+			if (overhead_flag) {
+				printf("Replay loop overhead, timed with a null allocator:\n");
+				printoverhead(num_tracefiles, mm_stats);
+				printf("\n");
+			}
+			if (perf_flag) {
+				printf("Performance counters per op:\n");
+				printperf(num_tracefiles, mm_stats);
+				printf("\n");
+			}
+			if (frag_interval) {
+				printf("Fragmentation, sampled every %lu ops into <trace>.frag.%s:\n",
+						frag_interval, frag_json ? "json" : "csv");
+				printfrag(num_tracefiles, mm_stats);
+				printf("\n");
+			}
+			if (fault_flag) {
+				printf("Page faults and cycles per op, transparent huge pages %s:\n",
+						thp_flag ? "on" : "off");
+				printfaults(num_tracefiles, mm_stats);
+				printf("\n");
+			}
 		}
 	}
 
@@ -509,22 +823,109 @@ int main(int argc, char **argv)
 		printf("perfidx:%.0f\n", perfindex);
 	}
 
+	/* Compare with the baseline before the results may overwrite it */
+	if (baseline_file && !onetime_flag)
+		regressions = compare_results(baseline_file, num_tracefiles, mm_stats);
+	if (results_file && !onetime_flag)
+		write_results(results_file, num_tracefiles, mm_stats,
+				avg_mm_util, ops, secs, perfindex);
+
 	/* Post result to Autolab */
 	sprintf(autoresult, "%d:%.0f:%.0f:%.0f",
 			numcorrect, (float)perfindex, 
 			avg_mm_throughput/1000.0, avg_mm_util*100);
 	driver_post(NULL, autoresult, autograder, status_msg);
 
-	exit(0);
+	exit(regressions ? 1 : 0);
 }
 
 
 /*****************************************************************
- * The following routines manipulate the range list, which keeps
+ * The following routines manipulate the range tree, which keeps
  * track of the extent of every allocated block payload. We use the
- * range list to detect any overlapping allocated blocks.
+ * range tree to detect any overlapping allocated blocks, with
+ * O(log n) insert, delete and overlap query.
  ****************************************************************/
 
+static range_t *range_pool;     /* free range nodes, linked by right */
+static unsigned int range_seed = 2463534242u;
+
+/*
+ * range_alloc - Take a node from the pool, carving a new chunk if it's empty
+ */
+static range_t *range_alloc(void)
+{
+	range_t *p;
+	int i;
+
+	if (range_pool == NULL) {
+		if ((p = (range_t *)malloc(RANGE_CHUNK * sizeof(range_t))) == NULL)
+			unix_error("malloc error in range_alloc");
+		for (i = 0; i < RANGE_CHUNK; i++)
+			p[i].right = (i + 1 < RANGE_CHUNK) ? &p[i + 1] : NULL;
+		range_pool = p;
+	}
+	p = range_pool;
+	range_pool = p->right;
+
+	/* xorshift32 for the treap priority */
+	range_seed ^= range_seed << 13;
+	range_seed ^= range_seed >> 17;
+	range_seed ^= range_seed << 5;
+	p->prio = range_seed;
+	p->left = p->right = NULL;
+	return p;
+}
+
+/*
+ * range_split - Split tree t into the ranges below lo and the rest
+ */
+static void range_split(range_t *t, char *lo, range_t **below, range_t **above)
+{
+	if (t == NULL) {
+		*below = *above = NULL;
+	} else if (t->lo < lo) {
+		range_split(t->right, lo, &t->right, above);
+		*below = t;
+	} else {
+		range_split(t->left, lo, below, &t->left);
+		*above = t;
+	}
+}
+
+/*
+ * range_merge - Join two trees, all of a lying below all of b
+ */
+static range_t *range_merge(range_t *a, range_t *b)
+{
+	if (a == NULL)
+		return b;
+	if (b == NULL)
+		return a;
+	if (a->prio > b->prio) {
+		a->right = range_merge(a->right, b);
+		return a;
+	}
+	b->left = range_merge(a, b->left);
+	return b;
+}
+
+/*
+ * range_insert - Put node p into tree t and return the new root
+ */
+static range_t *range_insert(range_t *t, range_t *p)
+{
+	if (t == NULL || p->prio > t->prio) {
+		range_split(t, p->lo, &p->left, &p->right);
+		return p;
+	}
+	if (p->lo < t->lo)
+		t->left = range_insert(t->left, p);
+	else
+		t->right = range_insert(t->right, p);
+	return t;
+}
+
 /*
  * add_range - As directed by request opnum in trace tracenum,
  *     we've just called the student's mm_malloc to allocate a block of
@@ -535,7 +936,7 @@ static int add_range(range_t **ranges, char *lo, int size,
 		const trace_t *trace, int opnum, int index)
 {
 	char *hi = lo + size - 1;
-	range_t *p;
+	range_t *p, *below, *above;
 
 	assert(size > 0);
 
@@ -547,43 +948,54 @@ static int add_range(range_t **ranges, char *lo, int size,
 	}
 
 	/* The payload must lie within the extent of the heap */
-	if ((lo < (char *)mem_heap_lo()) || (lo > (char *)mem_heap_hi()) ||
-			(hi < (char *)mem_heap_lo()) || (hi > (char *)mem_heap_hi())) {
+	/* ... or within a region the package mapped with mem_map */
+	if (!mem_contains(lo, hi)) {
 		malloc_error(trace, opnum,
 				"Payload (%p:%p) lies outside heap (%p:%p)",
 				lo, hi, mem_heap_lo(), mem_heap_hi());
 		return 0;
 	}
 
-	/* If we can't afford the linear-time loop, we check less thoroughly and
-	   just assume the overlap will be caught by writing random bits. */
+	/* The trace may ask for the overlap check to be skipped */
 	if(trace->ignore_ranges || debug_mode == DBG_NONE) return 1;
 
-
-	/* The payload must not overlap any other payloads */
-	for (p = *ranges;  p != NULL;  p = p->next) {
-		if ((lo >= p->lo && lo <= p-> hi) ||
-				(hi >= p->lo && hi <= p->hi)) {
-			malloc_error(trace, opnum,
-					"Payload (%p:%p) overlaps another payload (%p:%p)\n",
-					lo, hi, p->lo, p->hi);
-			return 0;
+	/*
+	 * The payload must not overlap any other payloads. Those don't
+	 * overlap each other, so only the nearest range starting at or
+	 * below lo and the nearest one starting above it need checking.
+	 */
+	below = above = NULL;
+	for (p = *ranges;  p != NULL; ) {
+		if (p->lo <= lo) {
+			below = p;
+			p = p->right;
+		} else {
+			above = p;
+			p = p->left;
 		}
 	}
+	if ((p = below) != NULL && p->hi >= lo)
+		goto overlap;
+	if ((p = above) != NULL && p->lo <= hi)
+		goto overlap;
 
 	/*
 	 * Everything looks OK, so remember the extent of this block
-	 * by creating a range struct and adding it the range list.
+	 * by creating a range struct and adding it the range tree.
 	 */
-	if ((p = (range_t *)malloc(sizeof(range_t))) == NULL)
-		unix_error("malloc error in add_range");
-	p->next = *ranges;
+	p = range_alloc();
 	p->lo = lo;
 	p->hi = hi;
 	p->index = index;
-	*ranges = p;
+	*ranges = range_insert(*ranges, p);
 
 	return 1;
+
+overlap:
+	malloc_error(trace, opnum,
+			"Payload (%p:%p) overlaps another payload (%p:%p)\n",
+			lo, hi, p->lo, p->hi);
+	return 0;
 }
 
 /*
@@ -592,17 +1004,13 @@ static int add_range(range_t **ranges, char *lo, int size,
 static void remove_range(range_t **ranges, char *lo)
 {
 	range_t *p;
-	range_t **prevpp = ranges;
-	// int size;
-
-	for (p = *ranges;  p != NULL; p = p->next) {
-		if (p->lo == lo) {
-			*prevpp = p->next;
-			// size = p->hi - p->lo + 1;
-			free(p);
-			break;
-		}
-		prevpp = &(p->next);
+
+	while ((p = *ranges) != NULL && p->lo != lo)
+		ranges = (lo < p->lo) ? &p->left : &p->right;
+	if (p != NULL) {
+		*ranges = range_merge(p->left, p->right);
+		p->right = range_pool;
+		range_pool = p;
 	}
 }
 
@@ -611,14 +1019,26 @@ static void remove_range(range_t **ranges, char *lo)
  */
 static void clear_ranges(range_t **ranges)
 {
-	range_t *p;
-	range_t *pnext;
+	range_t *p = *ranges;
+
+	if (p == NULL)
+		return;
+	clear_ranges(&p->left);
+	clear_ranges(&p->right);
+	p->right = range_pool;
+	range_pool = p;
+	*ranges = NULL;
+}
 
-	for (p = *ranges;  p != NULL;  p = pnext) {
-		pnext = p->next;
-		free(p);
+/*
+ * check_ranges - check the data of every block in the range tree
+ */
+static void check_ranges(const range_t *ranges, const trace_t *trace, int opnum)
+{
+	for (; ranges != NULL; ranges = ranges->right) {
+		check_ranges(ranges->left, trace, opnum);
+		check_index(trace, opnum, ranges->index);
 	}
-	*ranges = NULL;
 }
 
 /**********************************************
@@ -696,7 +1116,7 @@ static trace_t *read_trace(stats_t *stats, const char *tracedir,
 	FILE *tracefile;
 	trace_t *trace;
 	char type[MAXLINE];
-	int index, size;
+	int index, size, align;
 	int max_index = 0;
 	int op_index;
 
@@ -713,8 +1133,23 @@ static trace_t *read_trace(stats_t *stats, const char *tracedir,
 	if ((tracefile = fopen(trace->filename, "r")) == NULL) {
 		unix_error("Could not open %s in read_trace", trace->filename);
 	}
+	trace->map = NULL;
+	trace->map_len = 0;
+
+	/* A binary trace is mapped and replayed as it is */
+	if (ungetc(getc(tracefile), tracefile) == BT_MAGIC[0]) {
+		read_bintrace(trace, fileno(tracefile), NULL);
+		fclose(tracefile);
+		strcpy(stats->filename, trace->filename);
+		stats->weight = trace->weight;
+		stats->ops = trace->num_ops;
+		return trace;
+	}
+
 	if (fscanf(tracefile, "%d", &trace->weight)) {}
 	if (fscanf(tracefile, "%d", &trace->num_ids)) {}
+	if (trace->num_ids > BT_MAX_INDEX + 1)
+		app_error("%s: too many block ids\n", trace->filename);
 	if (fscanf(tracefile, "%d", &trace->num_ops)) {}
 	if (fscanf(tracefile, "%d", &trace->ignore_ranges)) {}
 
@@ -730,20 +1165,7 @@ static trace_t *read_trace(stats_t *stats, const char *tracedir,
 				(traceop_t *)malloc(trace->num_ops * sizeof(traceop_t))) == NULL)
 		unix_error("malloc 2 failed in read_trace");
 
-	/* We'll keep an array of pointers to the allocated blocks here... */
-	if ((trace->blocks =
-				(char **)calloc(trace->num_ids, sizeof(char *))) == NULL)
-		unix_error("malloc 3 failed in read_trace");
-
-	/* ... along with the corresponding byte sizes of each block */
-	if ((trace->block_sizes =
-				(size_t *)calloc(trace->num_ids,  sizeof(size_t))) == NULL)
-		unix_error("malloc 4 failed in read_trace");
-
-	/* and, if we're debugging, the offset into the random data */
-	if ((trace->block_rand_base =
-				calloc(trace->num_ids, sizeof(*trace->block_rand_base))) == NULL)
-		unix_error("malloc 5 failed in read_trace");
+	alloc_trace_blocks(trace);
 
 
 	/* read every request line in the trace file */
@@ -756,6 +1178,7 @@ static trace_t *read_trace(stats_t *stats, const char *tracedir,
 				trace->ops[op_index].type = ALLOC;
 				trace->ops[op_index].index = index;
 				trace->ops[op_index].size = size;
+				trace->ops[op_index].align = 0;
 				max_index = (index > max_index) ? index : max_index;
 				break;
 			case 'r':
@@ -763,12 +1186,33 @@ static trace_t *read_trace(stats_t *stats, const char *tracedir,
 				trace->ops[op_index].type = REALLOC;
 				trace->ops[op_index].index = index;
 				trace->ops[op_index].size = size;
+				trace->ops[op_index].align = 0;
+				max_index = (index > max_index) ? index : max_index;
+				break;
+			case 'c':
+				if (fscanf(tracefile, "%d %d", &index, &size)) {}
+				trace->ops[op_index].type = CALLOC;
+				trace->ops[op_index].index = index;
+				trace->ops[op_index].size = size;
+				trace->ops[op_index].align = 0;
+				max_index = (index > max_index) ? index : max_index;
+				break;
+			case 'm':
+				if (fscanf(tracefile, "%d %d %d", &index, &size, &align)) {}
+				if (align <= 0 || (align & (align - 1)) != 0)
+					app_error("%s: alignment %d of request %d is not a power of two\n",
+							trace->filename, align, op_index);
+				trace->ops[op_index].type = MEMALIGN;
+				trace->ops[op_index].index = index;
+				trace->ops[op_index].size = size;
+				trace->ops[op_index].align = align;
 				max_index = (index > max_index) ? index : max_index;
 				break;
 			case 'f':
 				if (fscanf(tracefile, "%ud", &index)) {}
 				trace->ops[op_index].type = FREE;
 				trace->ops[op_index].index = index;
+				trace->ops[op_index].align = 0;
 				break;
 			default:
 				app_error("Bogus type character (%c) in tracefile %s\n",
@@ -797,7 +1241,7 @@ static trace_t *read_trace_stdin(stats_t *stats)
 	FILE *tracefile;
 	trace_t *trace;
 	char type[MAXLINE];
-	int index, size;
+	int index, size, align;
 	int max_index = 0;
 	int op_index;
 
@@ -811,9 +1255,22 @@ static trace_t *read_trace_stdin(stats_t *stats)
 	/* Read the trace file header */
 	strcpy(trace->filename, "stdin");
 	tracefile = stdin;
+	trace->map = NULL;
+	trace->map_len = 0;
+
+	/* A binary trace on stdin can't be mapped, it is read in one go */
+	if (ungetc(getc(tracefile), tracefile) == BT_MAGIC[0]) {
+		read_bintrace(trace, -1, tracefile);
+		strcpy(stats->filename, "stdin");
+		stats->weight = trace->weight;
+		stats->ops = trace->num_ops;
+		return trace;
+	}
 
 	if (fscanf(tracefile, "%d", &trace->weight)) {}
 	if (fscanf(tracefile, "%d", &trace->num_ids)) {}
+	if (trace->num_ids > BT_MAX_INDEX + 1)
+		app_error("%s: too many block ids\n", trace->filename);
 	if (fscanf(tracefile, "%d", &trace->num_ops)) {}
 	if (fscanf(tracefile, "%d", &trace->ignore_ranges)) {}
 
@@ -829,20 +1286,7 @@ static trace_t *read_trace_stdin(stats_t *stats)
 				(traceop_t *)malloc(trace->num_ops * sizeof(traceop_t))) == NULL)
 		unix_error("malloc 2 failed in read_trace");
 
-	/* We'll keep an array of pointers to the allocated blocks here... */
-	if ((trace->blocks =
-				(char **)calloc(trace->num_ids, sizeof(char *))) == NULL)
-		unix_error("malloc 3 failed in read_trace");
-
-	/* ... along with the corresponding byte sizes of each block */
-	if ((trace->block_sizes =
-				(size_t *)calloc(trace->num_ids,  sizeof(size_t))) == NULL)
-		unix_error("malloc 4 failed in read_trace");
-
-	/* and, if we're debugging, the offset into the random data */
-	if ((trace->block_rand_base =
-				calloc(trace->num_ids, sizeof(*trace->block_rand_base))) == NULL)
-		unix_error("malloc 5 failed in read_trace");
+	alloc_trace_blocks(trace);
 
 
 	/* read every request line in the trace file */
@@ -855,6 +1299,7 @@ static trace_t *read_trace_stdin(stats_t *stats)
 				trace->ops[op_index].type = ALLOC;
 				trace->ops[op_index].index = index;
 				trace->ops[op_index].size = size;
+				trace->ops[op_index].align = 0;
 				max_index = (index > max_index) ? index : max_index;
 				break;
 			case 'r':
@@ -862,12 +1307,33 @@ static trace_t *read_trace_stdin(stats_t *stats)
 				trace->ops[op_index].type = REALLOC;
 				trace->ops[op_index].index = index;
 				trace->ops[op_index].size = size;
+				trace->ops[op_index].align = 0;
+				max_index = (index > max_index) ? index : max_index;
+				break;
+			case 'c':
+				if (fscanf(tracefile, "%d %d", &index, &size)) {}
+				trace->ops[op_index].type = CALLOC;
+				trace->ops[op_index].index = index;
+				trace->ops[op_index].size = size;
+				trace->ops[op_index].align = 0;
+				max_index = (index > max_index) ? index : max_index;
+				break;
+			case 'm':
+				if (fscanf(tracefile, "%d %d %d", &index, &size, &align)) {}
+				if (align <= 0 || (align & (align - 1)) != 0)
+					app_error("%s: alignment %d of request %d is not a power of two\n",
+							trace->filename, align, op_index);
+				trace->ops[op_index].type = MEMALIGN;
+				trace->ops[op_index].index = index;
+				trace->ops[op_index].size = size;
+				trace->ops[op_index].align = align;
 				max_index = (index > max_index) ? index : max_index;
 				break;
 			case 'f':
 				if (fscanf(tracefile, "%ud", &index)) {}
 				trace->ops[op_index].type = FREE;
 				trace->ops[op_index].index = index;
+				trace->ops[op_index].align = 0;
 				break;
 			default:
 				app_error("Bogus type character (%c) from stdin\n",
@@ -888,6 +1354,104 @@ static trace_t *read_trace_stdin(stats_t *stats)
 	return trace;
 }
 
+/*
+ * alloc_trace_blocks - allocate the per-block arrays of a trace
+ *     whose header has been read
+ */
+static void alloc_trace_blocks(trace_t *trace)
+{
+	/* We'll keep an array of pointers to the allocated blocks here... */
+	if ((trace->blocks =
+				(char **)calloc(trace->num_ids, sizeof(char *))) == NULL)
+		unix_error("malloc 3 failed in read_trace");
+
+	/* ... along with the corresponding byte sizes of each block */
+	if ((trace->block_sizes =
+				(size_t *)calloc(trace->num_ids,  sizeof(size_t))) == NULL)
+		unix_error("malloc 4 failed in read_trace");
+
+	/* and, if we're debugging, the offset into the random data */
+	if ((trace->block_rand_base =
+				calloc(trace->num_ids, sizeof(*trace->block_rand_base))) == NULL)
+		unix_error("malloc 5 failed in read_trace");
+}
+
+/*
+ * read_bintrace - set up a trace from a binary trace file (see
+ *     bintrace.h). A file fd is mapped and its ops are used in place,
+ *     a stream that can't be mapped is read into memory instead. The
+ *     ops are only checked, not parsed.
+ */
+static void read_bintrace(trace_t *trace, int fd, FILE *stream)
+{
+	bt_header_t hdr;
+	struct stat st;
+	char *base;
+	size_t len;
+	int i;
+
+	if (stream == NULL) {
+		if (fstat(fd, &st) < 0)
+			unix_error("fstat failed on %s", trace->filename);
+		len = st.st_size;
+		if (len < sizeof(hdr))
+			app_error("%s: truncated binary trace\n", trace->filename);
+		base = mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (base == MAP_FAILED)
+			unix_error("mmap failed on %s", trace->filename);
+		trace->map = base;
+		trace->map_len = len;
+		memcpy(&hdr, base, sizeof(hdr));
+	} else {
+		if (fread(&hdr, sizeof(hdr), 1, stream) != 1)
+			app_error("%s: truncated binary trace\n", trace->filename);
+		base = NULL;
+		len = hdr.ops_offset + (size_t)hdr.num_ops * sizeof(traceop_t);
+	}
+
+	if (memcmp(hdr.magic, BT_MAGIC, BT_MAGIC_LEN) != 0 || hdr.version != BT_VERSION)
+		app_error("%s: not a version %d binary trace\n", trace->filename, BT_VERSION);
+	if (hdr.num_ops < 0 || hdr.num_ids < 0 ||
+			hdr.ops_offset < sizeof(hdr) ||
+			hdr.ops_offset + (size_t)hdr.num_ops * sizeof(traceop_t) > len)
+		app_error("%s: truncated binary trace\n", trace->filename);
+	trace->weight = hdr.weight;
+	trace->num_ids = hdr.num_ids;
+	trace->num_ops = hdr.num_ops;
+	trace->ignore_ranges = hdr.ignore_ranges;
+	if(trace->weight != 0 && trace->weight != 1) {
+		app_error("%s: weight can only be zero or one", trace->filename);
+	}
+	if(trace->ignore_ranges != 0 && trace->ignore_ranges != 1) {
+		app_error("%s: ignore-ranges can only be zero or one", trace->filename);
+	}
+
+	if (stream == NULL) {
+		trace->ops = (traceop_t *)(base + hdr.ops_offset);
+	} else {
+		if ((trace->ops =
+					(traceop_t *)malloc(trace->num_ops * sizeof(traceop_t))) == NULL)
+			unix_error("malloc 2 failed in read_trace");
+		for (len = sizeof(hdr); len < hdr.ops_offset; len++)
+			getc(stream);
+		if (fread(trace->ops, sizeof(traceop_t), trace->num_ops, stream) !=
+				(size_t)trace->num_ops)
+			app_error("%s: truncated binary trace\n", trace->filename);
+	}
+
+	/* Every request must name a block of the trace */
+	for (i = 0; i < trace->num_ops; i++) {
+		if (trace->ops[i].type >= BT_NUM_TYPES || trace->ops[i].index >= trace->num_ids ||
+				trace->ops[i].index < -1 ||
+				(trace->ops[i].index == -1 && trace->ops[i].type != FREE) ||
+				(trace->ops[i].type == MEMALIGN && (trace->ops[i].align == 0 ||
+					(trace->ops[i].align & (trace->ops[i].align - 1)) != 0)))
+			app_error("%s: bad request %d in binary trace\n", trace->filename, i);
+	}
+
+	alloc_trace_blocks(trace);
+}
+
 /*
  * reinit_trace - get the trace ready for another run.
  */
@@ -898,13 +1462,30 @@ static void reinit_trace(trace_t *trace)
 	/* block_rand_base is unused if size is zero */
 }
 
+/*
+ * compile_trace - compile the trace for replay_mm and friends, touching
+ *     touch_bytes of each payload
+ */
+static replay_t *compile_trace(trace_t *trace)
+{
+	replay_t *r = replay_compile(trace->ops, trace->num_ops, trace->num_ids);
+	if (r == NULL)
+		unix_error("replay_compile failed in compile_trace");
+	replay_set_touch(r, touch_bytes);
+	return r;
+}
+
 /*
  * free_trace - Free the trace record and the four arrays it points
  *              to, all of which were allocated in read_trace().
  */
 static void free_trace(trace_t *trace)
 {
-	free(trace->ops);         /* free the three arrays... */
+	if (trace->map)           /* unmap or free the ops... */
+		munmap(trace->map, trace->map_len);
+	else
+		free(trace->ops);
+	/* ... and the three arrays */
 	free(trace->blocks);
 	free(trace->block_sizes);
 	free(trace->block_rand_base);
@@ -916,6 +1497,41 @@ static void free_trace(trace_t *trace)
  * and throughput of the libc and mm malloc packages.
  **********************************************************************/
 
+/*
+ * The requests of eval_mm_valid go to valid_heap when eval_heap_valid
+ * has made one, else to the malloc heap. A heap of its own has no
+ * memalign, so there a MEMALIGN request is a plain malloc.
+ */
+static mm_heap_t *valid_heap;
+
+static void *valid_malloc(size_t size)
+{
+	return valid_heap ? mm_heap_malloc(valid_heap, size) : mm_malloc(size);
+}
+
+static void *valid_calloc(size_t nmemb, size_t size)
+{
+	return valid_heap ? mm_heap_calloc(valid_heap, nmemb, size) : mm_calloc(nmemb, size);
+}
+
+static void *valid_memalign(size_t align, size_t size)
+{
+	return valid_heap ? mm_heap_malloc(valid_heap, size) : mm_memalign(align, size);
+}
+
+static void *valid_realloc(void *ptr, size_t size)
+{
+	return valid_heap ? mm_heap_realloc(valid_heap, ptr, size) : mm_realloc(ptr, size);
+}
+
+static void valid_free(void *ptr)
+{
+	if (valid_heap)
+		mm_heap_free(valid_heap, ptr);
+	else
+		mm_free(ptr);
+}
+
 /*
  * eval_mm_valid - Check the mm malloc package for correctness
  */
@@ -923,12 +1539,12 @@ static int eval_mm_valid(trace_t *trace, range_t **ranges)
 {
 	int i;
 	int index;
-	size_t size;
+	size_t size, j;
 	char *newp;
 	char *oldp;
 	char *p;
 
-	/* Reset the heap and free any records in the range list */
+	/* Reset the heap and free any records in the range tree */
 	mem_reset_brk();
 	clear_ranges(ranges);
 	reinit_trace(trace);
@@ -945,17 +1561,11 @@ static int eval_mm_valid(trace_t *trace, range_t **ranges)
 		size = trace->ops[i].size;
 
 		if(debug_mode == DBG_EXPENSIVE) {
-			range_t *r;
-			
 			/* Let the students check their own heap */
 			mm_checkheap(verbose);
 
 			/* Now check that all our allocated blocks have the right data */
-			r = *ranges;
-			while(r) {
-				check_index(trace, i, r->index);
-				r = r->next;
-			}
+			check_ranges(*ranges, trace, i);
 		}
 
 		switch (trace->ops[i].type) {
@@ -963,14 +1573,14 @@ static int eval_mm_valid(trace_t *trace, range_t **ranges)
 			case ALLOC: /* mm_malloc */
 
 				/* Call the student's malloc */
-				if ((p = mm_malloc(size)) == NULL) {
+				if ((p = valid_malloc(size)) == NULL) {
 					malloc_error(trace, i, "mm_malloc failed.");
 					return 0;
 				}
 
 				/*
 				 * Test the range of the new block for correctness and add it
-				 * to the range list if OK. The block must be  be aligned properly,
+				 * to the range tree if OK. The block must be  be aligned properly,
 				 * and must not overlap any currently allocated block.
 				 */
 				if (add_range(ranges, p, size, trace, i, index) == 0)
@@ -984,34 +1594,78 @@ static int eval_mm_valid(trace_t *trace, range_t **ranges)
 				randomize_block(trace, index);
 				break;
 
-			case REALLOC: /* mm_realloc */
-				check_index(trace, i, index);
+			case CALLOC: /* mm_calloc */
 
-				/* Call the student's realloc */
-				oldp = trace->blocks[index];
-				newp = mm_realloc(oldp, size);
-				if( (newp == NULL) && (size != 0) ) {
-					malloc_error(trace, i, "mm_realloc failed.");
+				if ((p = valid_calloc(1, size)) == NULL) {
+					malloc_error(trace, i, "mm_calloc failed.");
 					return 0;
 				}
-				if( (newp != NULL) && (size == 0) ) {
-					malloc_error(trace, i, "mm_realloc with size 0 returned "
-							"non-NULL.");
+				if (add_range(ranges, p, size, trace, i, index) == 0)
 					return 0;
+
+				/* Every byte must read as zero */
+				for (j = 0; j < size; j++) {
+					if (p[j] != 0) {
+						malloc_error(trace, i, "mm_calloc left byte %zu of %zu nonzero",
+								j, size);
+						return 0;
+					}
 				}
 
+				trace->blocks[index] = p;
+				trace->block_sizes[index] = size;
+				randomize_block(trace, index);
+				break;
 
-				/* Remove the old region from the range list */
-				remove_range(ranges, oldp);
+			case MEMALIGN: /* mm_memalign */
 
-				/* Check new block for correctness and add it to range list */
-				if (size > 0) {
-					if(add_range(ranges, newp, size, trace, i, index) == 0)
-						return 0;
+				if ((p = valid_memalign(trace->ops[i].align, size)) == NULL) {
+					malloc_error(trace, i, "mm_memalign failed.");
+					return 0;
 				}
 
+				/* Besides the checks of add_range, p must have the alignment asked for */
+				if (valid_heap == NULL && ((unsigned long)p & (trace->ops[i].align - 1)) != 0) {
+					malloc_error(trace, i, "Payload address (%p) not aligned to %u bytes",
+							p, trace->ops[i].align);
+					return 0;
+				}
+				if (add_range(ranges, p, size, trace, i, index) == 0)
+					return 0;
 
-				/* Move the region from where it was.
+				trace->blocks[index] = p;
+				trace->block_sizes[index] = size;
+				randomize_block(trace, index);
+				break;
+
+			case REALLOC: /* mm_realloc */
+				check_index(trace, i, index);
+
+				/* Call the student's realloc */
+				oldp = trace->blocks[index];
+				newp = valid_realloc(oldp, size);
+				if( (newp == NULL) && (size != 0) ) {
+					malloc_error(trace, i, "mm_realloc failed.");
+					return 0;
+				}
+				if( (newp != NULL) && (size == 0) ) {
+					malloc_error(trace, i, "mm_realloc with size 0 returned "
+							"non-NULL.");
+					return 0;
+				}
+
+
+				/* Remove the old region from the range tree */
+				remove_range(ranges, oldp);
+
+				/* Check new block for correctness and add it to range tree */
+				if (size > 0) {
+					if(add_range(ranges, newp, size, trace, i, index) == 0)
+						return 0;
+				}
+
+
+				/* Move the region from where it was.
 				 * Check up to min(size, oldsize) for correct copying. */
 				trace->blocks[index] = newp;
 				if(size < trace->block_sizes[index]) {
@@ -1027,14 +1681,14 @@ static int eval_mm_valid(trace_t *trace, range_t **ranges)
 			case FREE: /* mm_free */
 				check_index(trace, i, index);
 
-				/* Remove region from list and call student's free function */
+				/* Remove region from tree and call student's free function */
 				if(index == -1) {
 					p = 0;
 				} else {
 					p = trace->blocks[index];
 					remove_range(ranges, p);
 				}
-				mm_free(p);
+				valid_free(p);
 				break;
 
 			default:
@@ -1047,15 +1701,46 @@ static int eval_mm_valid(trace_t *trace, range_t **ranges)
 	return 1;
 }
 
+/*
+ * eval_heap_valid - Check the trace as eval_mm_valid does, in a heap
+ *   from mm_heap_create that is destroyed afterwards. Where counters
+ *   are kept, the heap must have counted its own mallocs and left those
+ *   of the malloc heap alone.
+ */
+static int eval_heap_valid(trace_t *trace, range_t **ranges)
+{
+	mm_stats_t own, dflt;
+	unsigned long allocs = 0;
+	int valid;
+
+	for (int i = 0; i < trace->num_ops; i++)
+		allocs += trace->ops[i].type == ALLOC || trace->ops[i].type == CALLOC ||
+			trace->ops[i].type == MEMALIGN;
+	if ((valid_heap = mm_heap_create(MAX_HEAP)) == NULL)
+		unix_error("mm_heap_create failed in eval_heap_valid");
+	valid = eval_mm_valid(trace, ranges);
+	if (valid && mm_heap_get_stats(valid_heap, &own) == 0 && mm_get_stats(&dflt) == 0 &&
+			(dflt.malloc_calls + dflt.calloc_calls + dflt.memalign_calls != 0 ||
+			 own.malloc_calls + own.calloc_calls < allocs)) {
+		malloc_error(trace, trace->num_ops, "heap of its own counted %lu mallocs, "
+				"the malloc heap %lu", own.malloc_calls + own.calloc_calls,
+				dflt.malloc_calls + dflt.calloc_calls + dflt.memalign_calls);
+		valid = 0;
+	}
+	mm_heap_destroy(valid_heap);
+	valid_heap = NULL;
+	clear_ranges(ranges);
+	return valid;
+}
+
 /*
  * eval_mm_util - Evaluate the space utilization of the student's package
  *   The idea is to remember the high water mark "hwm" of the heap for
  *   an optimal allocator, i.e., no gaps and no internal fragmentation.
  *   Utilization is the ratio hwm/heapsize, where heapsize is the
  *   size of the heap in bytes after running the student's malloc
- *   package on the trace. Note that our implementation of mem_sbrk()
- *   doesn't allow the students to decrement the brk pointer, so brk
- *   is always the high water mark of the heap.
+ *   package on the trace. mem_sbrk() lets the package decrement the
+ *   brk pointer, so the heap size used is the high water mark of brk.
  *
  *   A higher number is better: 1 is optimal.
  */
@@ -1071,8 +1756,10 @@ static double eval_mm_util(trace_t *trace, int tracenum)
 
 	reinit_trace(trace);
 
-	/* initialize the heap and the mm malloc package */
+	/* initialize the heap and the mm malloc package, on fresh pages
+	 * as a new process would have them, for the -M counters */
 	mem_reset_brk();
+	mem_decommit();
 	if (mm_init() < 0)
 		app_error("trace %d: mm_init failed in eval_mm_util", tracenum);
 
@@ -1095,6 +1782,36 @@ static double eval_mm_util(trace_t *trace, int tracenum)
 				total_size += size;
 				break;
 
+			case CALLOC: /* mm_calloc */
+				index = trace->ops[i].index;
+				size = trace->ops[i].size;
+
+				if ((p = mm_calloc(1, size)) == NULL) {
+					app_error("trace %d: mm_calloc failed in eval_mm_util",
+							tracenum);
+				}
+
+				trace->blocks[index] = p;
+				trace->block_sizes[index] = size;
+
+				total_size += size;
+				break;
+
+			case MEMALIGN: /* mm_memalign */
+				index = trace->ops[i].index;
+				size = trace->ops[i].size;
+
+				if ((p = mm_memalign(trace->ops[i].align, size)) == NULL) {
+					app_error("trace %d: mm_memalign failed in eval_mm_util",
+							tracenum);
+				}
+
+				trace->blocks[index] = p;
+				trace->block_sizes[index] = size;
+
+				total_size += size;
+				break;
+
 			case REALLOC: /* mm_realloc */
 				index = trace->ops[i].index;
 				newsize = trace->ops[i].size;
@@ -1140,7 +1857,7 @@ static double eval_mm_util(trace_t *trace, int tracenum)
 
 	printf(".");
 
-	return ((double)max_total_size / (double)mem_heapsize());
+	return ((double)max_total_size / (double)mem_heap_peak());
 }
 
 
@@ -1150,50 +1867,427 @@ static double eval_mm_util(trace_t *trace, int tracenum)
  */
 static void eval_mm_speed(void *ptr)
 {
-	int i, index, size, newsize;
-	char *p, *newp, *oldp, *block;
-	trace_t *trace = ((speed_t *)ptr)->trace;
-	reinit_trace(trace);
-
 	/* Reset the heap and initialize the mm package */
 	mem_reset_brk();
 	if (mm_init() < 0)
 		app_error("mm_init failed in eval_mm_speed");
 
-	/* Interpret each trace request */
-	for (i = 0;  i < trace->num_ops;  i++)
+	/* Replay the compiled trace */
+	if (replay_mm(((speed_t *)ptr)->replay) < 0)
+		app_error("mm request failed in eval_mm_speed");
+}
+
+/*
+ * eval_null_speed - Time the replay loop against an allocator that
+ *    does nothing, which is the driver's own share of eval_mm_speed
+ */
+static void eval_null_speed(void *ptr)
+{
+	replay_null(((speed_t *)ptr)->replay);
+}
+
+/*
+ * eval_mm_latency - Run the trace once more, reading the serialized
+ *    cycle counter around every request, and record the cycles in the
+ *    histogram of its request type. This is a separate run from
+ *    eval_mm_speed so that reading the counter does not count in Kops.
+ */
+static void eval_mm_latency(trace_t *trace, stats_t *stats)
+{
+	int i, index;
+	size_t size;
+	char *p;
+	unsigned long long start, cycles = 0;
+
+	if (stats->lat == NULL &&
+			(stats->lat = (hist_t *)malloc((LAT_ALL + 1) * sizeof(hist_t))) == NULL)
+		unix_error("malloc failed in eval_mm_latency");
+	memset(stats->lat, 0, (LAT_ALL + 1) * sizeof(hist_t));
+
+	reinit_trace(trace);
+	mem_reset_brk();
+	if (mm_init() < 0)
+		app_error("mm_init failed in eval_mm_latency");
+
+	for (i = 0;  i < trace->num_ops;  i++) {
+		index = trace->ops[i].index;
+		size = trace->ops[i].size;
+		switch (trace->ops[i].type) {
+
+			case ALLOC: /* mm_malloc */
+				start = read_counter();
+				p = mm_malloc(size);
+				cycles = read_counter() - start;
+				if (p == NULL)
+					app_error("mm_malloc error in eval_mm_latency");
+				trace->blocks[index] = p;
+				break;
+
+			case CALLOC: /* mm_calloc */
+				start = read_counter();
+				p = mm_calloc(1, size);
+				cycles = read_counter() - start;
+				if (p == NULL)
+					app_error("mm_calloc error in eval_mm_latency");
+				trace->blocks[index] = p;
+				break;
+
+			case MEMALIGN: /* mm_memalign */
+				start = read_counter();
+				p = mm_memalign(trace->ops[i].align, size);
+				cycles = read_counter() - start;
+				if (p == NULL)
+					app_error("mm_memalign error in eval_mm_latency");
+				trace->blocks[index] = p;
+				break;
+
+			case REALLOC: /* mm_realloc */
+				start = read_counter();
+				p = mm_realloc(trace->blocks[index], size);
+				cycles = read_counter() - start;
+				if (p == NULL && size != 0)
+					app_error("mm_realloc error in eval_mm_latency");
+				trace->blocks[index] = p;
+				break;
+
+			case FREE: /* mm_free */
+				p = index < 0 ? NULL : trace->blocks[index];
+				start = read_counter();
+				mm_free(p);
+				cycles = read_counter() - start;
+				break;
+
+			default:
+				app_error("Nonexistent request type in eval_mm_latency");
+		}
+		hist_add(&stats->lat[trace->ops[i].type], cycles);
+	}
+
+	for (i = 0; i < LAT_ALL; i++)
+		hist_merge(&stats->lat[LAT_ALL], &stats->lat[i]);
+}
+
+/*
+ * eval_mm_heap - Run the trace once more on a heap with no resident
+ *    pages, and record the peak and final heap size and the resident
+ *    heap bytes, then the same after mm_trim(0) gives back what it can.
+ */
+static void eval_mm_heap(trace_t *trace, stats_t *stats)
+{
+	int i, index;
+	size_t size;
+	char *p;
+
+	reinit_trace(trace);
+	mem_reset_brk();
+	mem_decommit();
+	if (mm_init() < 0)
+		app_error("mm_init failed in eval_mm_heap");
+
+	for (i = 0;  i < trace->num_ops;  i++) {
+		index = trace->ops[i].index;
+		size = trace->ops[i].size;
 		switch (trace->ops[i].type) {
 
 			case ALLOC: /* mm_malloc */
-				index = trace->ops[i].index;
-				size = trace->ops[i].size;
 				if ((p = mm_malloc(size)) == NULL)
-					app_error("mm_malloc error in eval_mm_speed");
+					app_error("mm_malloc error in eval_mm_heap");
+				trace->blocks[index] = p;
+				break;
+
+			case CALLOC: /* mm_calloc */
+				if ((p = mm_calloc(1, size)) == NULL)
+					app_error("mm_calloc error in eval_mm_heap");
+				trace->blocks[index] = p;
+				break;
+
+			case MEMALIGN: /* mm_memalign */
+				if ((p = mm_memalign(trace->ops[i].align, size)) == NULL)
+					app_error("mm_memalign error in eval_mm_heap");
 				trace->blocks[index] = p;
 				break;
 
 			case REALLOC: /* mm_realloc */
-				index = trace->ops[i].index;
-				newsize = trace->ops[i].size;
-				oldp = trace->blocks[index];
-				if ((newp = mm_realloc(oldp,newsize)) == NULL && newsize != 0)
-					app_error("mm_realloc error in eval_mm_speed");
-				trace->blocks[index] = newp;
+				p = mm_realloc(trace->blocks[index], size);
+				if (p == NULL && size != 0)
+					app_error("mm_realloc error in eval_mm_heap");
+				trace->blocks[index] = p;
 				break;
 
 			case FREE: /* mm_free */
-				index = trace->ops[i].index;
-				if(index < 0) {
-					block = 0;
-				} else {
-					block = trace->blocks[index];
+				mm_free(index < 0 ? NULL : trace->blocks[index]);
+				break;
+
+			default:
+				app_error("Nonexistent request type in eval_mm_heap");
+		}
+	}
+
+	stats->heap_peak = mem_heap_peak();
+	stats->heap_end = mem_heapsize() + mem_mapped();
+	stats->rss_end = mem_heap_rss();
+	mm_trim(0);
+	stats->heap_trim = mem_heapsize() + mem_mapped();
+	stats->rss_trim = mem_heap_rss();
+}
+
+/*
+ * frag_sample - Write a sample of the heap after op to out, and fold
+ *    it into the fragmentation stats of the trace
+ */
+static void frag_sample(FILE *out, stats_t *stats, int op, size_t live)
+{
+	mm_frag_t frag;
+	size_t heap = mem_heapsize() + mem_mapped();
+	int i;
+
+	mm_get_frag(&frag);
+	if (frag_json)
+		fprintf(out, "%s\n    {\"op\": %d, \"live\": %zu, \"heap\": %zu, "
+				"\"free\": %zu, \"largest_free\": %zu, \"free_blocks\": [",
+				stats->frag_samples ? "," : "", op, live, heap,
+				frag.free_bytes, frag.largest_free);
+	else
+		fprintf(out, "%d,%zu,%zu,%zu,%zu", op, live, heap,
+				frag.free_bytes, frag.largest_free);
+	for (i = 0; i < frag.nlists; i++)
+		fprintf(out, frag_json ? "%s%lu" : ",%s%lu",
+				frag_json && i ? ", " : "", frag.free_blocks[i]);
+	fprintf(out, frag_json ? "]}" : "\n");
+
+	if (stats->frag_samples++ == 0 || heap > stats->frag_peak) {
+		stats->frag_peak = heap;
+		stats->frag_peak_op = op;
+		stats->frag_peak_util = heap ? (double)live / heap : 0;
+	}
+	if (frag.free_bytes > 0 &&
+			1 - (double)frag.largest_free / frag.free_bytes > stats->frag_max_ext) {
+		stats->frag_max_ext = 1 - (double)frag.largest_free / frag.free_bytes;
+		stats->frag_ext_op = op;
+	}
+}
+
+/*
+ * eval_mm_frag - Run the trace and sample the live payload bytes, the
+ *    heap size and the free blocks every frag_interval ops and after
+ *    the last, into <trace>.frag.csv or .json in the current directory
+ */
+static void eval_mm_frag(trace_t *trace, stats_t *stats)
+{
+	int i, index;
+	size_t size, live = 0;
+	char *p, path[MAXLINE];
+	const char *name = strrchr(trace->filename, '/');
+	FILE *out;
+	mm_frag_t frag;
+
+	name = name ? name + 1 : trace->filename;
+	snprintf(path, sizeof(path), "%.*s.frag.%s",
+			(int)(strrchr(name, '.') ? strrchr(name, '.') - name : (long)strlen(name)),
+			name, frag_json ? "json" : "csv");
+	if ((out = fopen(path, "w")) == NULL)
+		unix_error("Could not open %s in eval_mm_frag", path);
+	stats->frag_samples = 0;
+	stats->frag_max_ext = 0;
+	stats->frag_ext_op = 0;
+
+	reinit_trace(trace);
+	mem_reset_brk();
+	mem_decommit();
+	if (mm_init() < 0)
+		app_error("mm_init failed in eval_mm_frag");
+
+	mm_get_frag(&frag);
+	if (frag_json) {
+		fprintf(out, "{\n  \"trace\": \"%s\",\n  \"interval\": %lu,\n"
+				"  \"lists\": %d,\n  \"samples\": [", trace->filename,
+				frag_interval, frag.nlists);
+	}
+	else {
+		fprintf(out, "op,live,heap,free,largest_free");
+		for (i = 0; i < frag.nlists; i++)
+			fprintf(out, ",list%d", i);
+		fprintf(out, "\n");
+	}
+
+	for (i = 0;  i < trace->num_ops;  i++) {
+		index = trace->ops[i].index;
+		size = trace->ops[i].size;
+		switch (trace->ops[i].type) {
+
+			case ALLOC: /* mm_malloc */
+				if ((p = mm_malloc(size)) == NULL)
+					app_error("mm_malloc error in eval_mm_frag");
+				trace->blocks[index] = p;
+				trace->block_sizes[index] = size;
+				live += size;
+				break;
+
+			case CALLOC: /* mm_calloc */
+				if ((p = mm_calloc(1, size)) == NULL)
+					app_error("mm_calloc error in eval_mm_frag");
+				trace->blocks[index] = p;
+				trace->block_sizes[index] = size;
+				live += size;
+				break;
+
+			case MEMALIGN: /* mm_memalign */
+				if ((p = mm_memalign(trace->ops[i].align, size)) == NULL)
+					app_error("mm_memalign error in eval_mm_frag");
+				trace->blocks[index] = p;
+				trace->block_sizes[index] = size;
+				live += size;
+				break;
+
+			case REALLOC: /* mm_realloc */
+				p = mm_realloc(trace->blocks[index], size);
+				if (p == NULL && size != 0)
+					app_error("mm_realloc error in eval_mm_frag");
+				live += size - trace->block_sizes[index];
+				trace->blocks[index] = p;
+				trace->block_sizes[index] = size;
+				break;
+
+			case FREE: /* mm_free */
+				if (index >= 0) {
+					mm_free(trace->blocks[index]);
+					live -= trace->block_sizes[index];
+					trace->block_sizes[index] = 0;
 				}
-				mm_free(block);
 				break;
 
 			default:
-				app_error("Nonexistent request type in eval_mm_speed");
+				app_error("Nonexistent request type in eval_mm_frag");
 		}
+		if ((i + 1) % frag_interval == 0)
+			frag_sample(out, stats, i + 1, live);
+	}
+	if (trace->num_ops % frag_interval != 0)
+		frag_sample(out, stats, trace->num_ops, live);
+
+	if (frag_json)
+		fprintf(out, "\n  ]\n}\n");
+	if (fclose(out) != 0)
+		unix_error("Could not write %s in eval_mm_frag", path);
+}
+
+/*
+ * eval_mm_faults - Run the trace on a heap with no resident pages and
+ *    count its page faults and cycles per op, then run it again on the
+ *    pages it left, and see how much of the heap is in huge pages.
+ */
+static void eval_mm_faults(speed_t *speed_params, stats_t *stats)
+{
+	struct rusage before, after;
+	double ops = speed_params->trace->num_ops ? speed_params->trace->num_ops : 1;
+
+	mem_reset_brk();
+	mem_decommit();
+	getrusage(RUSAGE_SELF, &before);
+	start_counter();
+	eval_mm_speed(speed_params);
+	stats->cold_cpo = get_counter() / ops;
+	getrusage(RUSAGE_SELF, &after);
+	stats->faults = (after.ru_minflt - before.ru_minflt) +
+		(after.ru_majflt - before.ru_majflt);
+	stats->thp = mem_heap_thp();
+
+	start_counter();
+	eval_mm_speed(speed_params);
+	stats->warm_cpo = get_counter() / ops;
+}
+
+/*
+ * eval_mm_perf - Run the trace once more with the performance counters
+ *    on, and record their counts per op. The counters are opened for
+ *    this run only; one that the startup probe found but that can't be
+ *    opened now is recorded as -1.
+ */
+static void eval_mm_perf(speed_t *speed_params, stats_t *stats)
+{
+	perf_t run;
+	double values[PERF_MAX];
+	double ops = speed_params->trace->num_ops ? speed_params->trace->num_ops : 1;
+	int i, j;
+
+	perf_open(&run);
+	perf_start(&run);
+	eval_mm_speed(speed_params);
+	perf_stop(&run, values);
+	perf_close(&run);
+	for (i = 0; i < perf.n; i++) {
+		stats->perf[i] = -1;
+		for (j = 0; j < run.n; j++)
+			if (run.name[j] == perf.name[i] && values[j] >= 0)
+				stats->perf[i] = values[j] / ops;
+	}
+}
+
+/**********************************************
+ * The following routines manipulate latency histograms
+ *********************************************/
+
+/*
+ * hist_add - Record one value in the histogram
+ */
+static void hist_add(hist_t *hist, unsigned long long value)
+{
+	int bucket;
+
+	if (value < HIST_SUB) {
+		bucket = value;
+	} else {
+		int msb = 63 - __builtin_clzll(value);
+		bucket = (msb - HIST_SUB_BITS + 1) * HIST_SUB +
+			((value >> (msb - HIST_SUB_BITS)) & (HIST_SUB - 1));
+	}
+	hist->count[bucket]++;
+	hist->n++;
+	if (value > hist->max)
+		hist->max = value;
+}
+
+/*
+ * hist_merge - Add every value recorded in src to dst
+ */
+static void hist_merge(hist_t *dst, const hist_t *src)
+{
+	int i;
+
+	for (i = 0; i < HIST_BUCKETS; i++)
+		dst->count[i] += src->count[i];
+	dst->n += src->n;
+	if (src->max > dst->max)
+		dst->max = src->max;
+}
+
+/*
+ * hist_percentile - Return the value below which pct percent of the
+ *     recorded values fall, as the highest value of its bucket
+ */
+static unsigned long long hist_percentile(const hist_t *hist, double pct)
+{
+	unsigned long long rank, seen = 0;
+	int i;
+
+	if (hist->n == 0)
+		return 0;
+	rank = (unsigned long long)(pct / 100.0 * hist->n + 0.5);
+	if (rank < 1)
+		rank = 1;
+	for (i = 0; i < HIST_BUCKETS; i++) {
+		seen += hist->count[i];
+		if (seen >= rank)
+			break;
+	}
+	if (i < HIST_SUB)
+		return i;
+	else {
+		int msb = i / HIST_SUB + HIST_SUB_BITS - 1;
+		unsigned long long hi =
+			((unsigned long long)(HIST_SUB + i % HIST_SUB + 1) << (msb - HIST_SUB_BITS)) - 1;
+		return hi < hist->max ? hi : hist->max;
+	}
 }
 
 /*
@@ -1220,6 +2314,22 @@ static int eval_libc_valid(trace_t *trace)
 				trace->blocks[trace->ops[i].index] = p;
 				break;
 
+			case CALLOC: /* calloc */
+				if ((p = calloc(1, trace->ops[i].size)) == NULL) {
+					malloc_error(trace, i, "libc calloc failed");
+					unix_error("System message");
+				}
+				trace->blocks[trace->ops[i].index] = p;
+				break;
+
+			case MEMALIGN: /* aligned_alloc */
+				if ((p = aligned_alloc(trace->ops[i].align, trace->ops[i].size)) == NULL) {
+					malloc_error(trace, i, "libc aligned_alloc failed");
+					unix_error("System message");
+				}
+				trace->blocks[trace->ops[i].index] = p;
+				break;
+
 			case REALLOC: /* realloc */
 				newsize = trace->ops[i].size;
 				oldp = trace->blocks[trace->ops[i].index];
@@ -1253,44 +2363,8 @@ static int eval_libc_valid(trace_t *trace)
  */
 static void eval_libc_speed(void *ptr)
 {
-	int i;
-	int index, size, newsize;
-	char *p, *newp, *oldp, *block;
-	trace_t *trace = ((speed_t *)ptr)->trace;
-
-	reinit_trace(trace);
-
-	for (i = 0;  i < trace->num_ops;  i++) {
-		switch (trace->ops[i].type) {
-			case ALLOC: /* malloc */
-				index = trace->ops[i].index;
-				size = trace->ops[i].size;
-				if ((p = malloc(size)) == NULL)
-					unix_error("malloc failed in eval_libc_speed");
-				trace->blocks[index] = p;
-				break;
-
-			case REALLOC: /* realloc */
-				index = trace->ops[i].index;
-				newsize = trace->ops[i].size;
-				oldp = trace->blocks[index];
-				if ((newp = realloc(oldp, newsize)) == NULL && newsize != 0)
-					unix_error("realloc failed in eval_libc_speed\n");
-
-				trace->blocks[index] = newp;
-				break;
-
-			case FREE: /* free */
-				index = trace->ops[i].index;
-				if(index >= 0) {
-					block = trace->blocks[index];
-					free(block);
-				} else {
-					free(0);
-				}
-				break;
-		}
-	}
+	if (replay_libc(((speed_t *)ptr)->replay) < 0)
+		unix_error("libc request failed in eval_libc_speed");
 }
 
 /*************************************
@@ -1311,18 +2385,32 @@ static void printresults(int n, stats_t *stats)
 	int sumweight = 0;
 
 	/* Print the individual results for each trace */
-	printf("  %6s%6s %5s%8s%12s  %s\n",
-			"valid", "util", "ops", "secs", "Kops", "trace");
+	if (latency_flag)
+		printf("  %6s%6s %5s%8s%12s%7s%7s%7s%7s%9s  %s\n",
+				"valid", "util", "ops", "secs", "Kops",
+				"p50", "p90", "p99", "p99.9", "max", "trace");
+	else
+		printf("  %6s%6s %5s%8s%12s  %s\n",
+				"valid", "util", "ops", "secs", "Kops", "trace");
 	for (i=0; i < n; i++) {
 		if (stats[i].valid) {
-			printf("%2s%4s %5.0f%%%8.0f%10.6f%9.0f %s\n",
+			printf("%2s%4s %5.0f%%%8.0f%10.6f%9.0f",
 					stats[i].weight != 0 ? "*" : "",
 					"yes",
 					stats[i].util*100.0,
 					stats[i].ops,
 					stats[i].secs,
-					(stats[i].ops/1e3)/stats[i].secs,
-					stats[i].filename);
+					(stats[i].ops/1e3)/stats[i].secs);
+			if (latency_flag && stats[i].lat)
+				printf("%7llu%7llu%7llu%7llu%9llu",
+						hist_percentile(&stats[i].lat[LAT_ALL], 50),
+						hist_percentile(&stats[i].lat[LAT_ALL], 90),
+						hist_percentile(&stats[i].lat[LAT_ALL], 99),
+						hist_percentile(&stats[i].lat[LAT_ALL], 99.9),
+						stats[i].lat[LAT_ALL].max);
+			else if (latency_flag)
+				printf("%7s%7s%7s%7s%9s", "-", "-", "-", "-", "-");
+			printf(" %s\n", stats[i].filename);
 			sumweight += stats[i].weight;
 			sumsecs += stats[i].secs * stats[i].weight;
 			sumops += stats[i].ops * stats[i].weight;
@@ -1360,6 +2448,586 @@ static void printresults(int n, stats_t *stats)
 
 }
 
+/*
+ * printlatency - prints the latency percentiles of each request type
+ */
+static void printlatency(int n, stats_t *stats)
+{
+	static const char *names[] = { "malloc", "free", "realloc", "memalign", "calloc" };
+	int i, t;
+
+	printf("%8s%10s%8s%8s%8s%8s%10s  %s\n",
+			"op", "count", "p50", "p90", "p99", "p99.9", "max", "trace");
+	for (i=0; i < n; i++) {
+		if (!stats[i].valid || stats[i].lat == NULL)
+			continue;
+		for (t = 0; t < LAT_ALL; t++) {
+			hist_t *h = &stats[i].lat[t];
+			if (h->n == 0)
+				continue;
+			printf("%8s%10llu%8llu%8llu%8llu%8llu%10llu  %s\n",
+					names[t], h->n,
+					hist_percentile(h, 50),
+					hist_percentile(h, 90),
+					hist_percentile(h, 99),
+					hist_percentile(h, 99.9),
+					h->max,
+					stats[i].filename);
+		}
+	}
+}
+
+/*
+ * printworst - prints the worst-case cycles of each request type, from
+ *     the same timed replay as the latency percentiles
+ */
+static void printworst(int n, stats_t *stats)
+{
+	int i, t;
+
+	printf("%10s%10s%10s%10s%10s  %s\n",
+			"malloc", "free", "realloc", "memalign", "calloc", "trace");
+	for (i=0; i < n; i++) {
+		for (t = 0; t < LAT_ALL; t++) {
+			if (!stats[i].valid || stats[i].lat == NULL || stats[i].lat[t].n == 0)
+				printf("%10s", "-");
+			else
+				printf("%10llu", stats[i].lat[t].max);
+		}
+		printf("  %s\n", stats[i].filename);
+	}
+}
+
+/*
+ * printheap - prints the heap size and resident bytes of each trace at
+ *     its end, and after mm_trim(0)
+ */
+static void printheap(int n, stats_t *stats)
+{
+	int i;
+
+	printf("%10s%10s%10s%10s%10s  %s\n",
+			"peak", "end", "rss", "trimmed", "rss", "trace");
+	for (i=0; i < n; i++) {
+		if (!stats[i].valid)
+			continue;
+		printf("%10zu%10zu%10zu%10zu%10zu  %s\n",
+				stats[i].heap_peak / 1024,
+				stats[i].heap_end / 1024,
+				stats[i].rss_end / 1024,
+				stats[i].heap_trim / 1024,
+				stats[i].rss_trim / 1024,
+				stats[i].filename);
+	}
+}
+
+/*
+ * printfrag - prints the largest heap each trace reached in its
+ *     samples and the share of it live then, and its worst external
+ *     fragmentation, the share of free bytes outside the largest free block
+ */
+static void printfrag(int n, stats_t *stats)
+{
+	int i;
+
+	printf("%8s%10s%10s%10s%10s%10s  %s\n",
+			"samples", "peak KB", "at op", "util", "ext frag", "at op", "trace");
+	for (i=0; i < n; i++) {
+		if (!stats[i].valid)
+			continue;
+		printf("%8d%10zu%10.0f%9.1f%%%9.1f%%%10.0f  %s\n",
+				stats[i].frag_samples,
+				stats[i].frag_peak / 1024,
+				stats[i].frag_peak_op,
+				stats[i].frag_peak_util * 100,
+				stats[i].frag_max_ext * 100,
+				stats[i].frag_ext_op,
+				stats[i].filename);
+	}
+}
+
+/*
+ * cmp_double - qsort order of doubles
+ */
+static int cmp_double(const void *a, const void *b)
+{
+	double x = *(const double *)a, y = *(const double *)b;
+	return (x > y) - (x < y);
+}
+
+/*
+ * median - the median of n values
+ */
+static double median(const double *values, int n)
+{
+	double sorted[MAX_TRIALS];
+
+	memcpy(sorted, values, n * sizeof(double));
+	qsort(sorted, n, sizeof(double), cmp_double);
+	return n % 2 ? sorted[n / 2] : (sorted[n / 2 - 1] + sorted[n / 2]) / 2;
+}
+
+/*
+ * write_json_string - write s as a JSON string, control characters
+ *     as \u escapes so that it stays on one line
+ */
+static void write_json_string(FILE *out, const char *s)
+{
+	fputc('"', out);
+	for (; *s; s++) {
+		if (*s == '"' || *s == '\\')
+			fprintf(out, "\\%c", *s);
+		else if ((unsigned char)*s < 0x20)
+			fprintf(out, "\\u%04x", *s);
+		else
+			fputc(*s, out);
+	}
+	fputc('"', out);
+}
+
+/*
+ * write_csv_string - write s as a CSV field, quoted with each '"'
+ *     doubled if it holds a comma, a quote or a line break
+ */
+static void write_csv_string(FILE *out, const char *s)
+{
+	if (strpbrk(s, ",\"\r\n") == NULL) {
+		fputs(s, out);
+		return;
+	}
+	fputc('"', out);
+	for (; *s; s++) {
+		if (*s == '"')
+			fputc('"', out);
+		fputc(*s, out);
+	}
+	fputc('"', out);
+}
+
+/*
+ * write_results - write the valid, util, ops, secs and Kops of each
+ *     trace with the secs of each of its timed runs, and the weighted
+ *     totals and perf index, to path as JSON or, if it ends in .csv, CSV
+ */
+static void write_results(const char *path, int n, stats_t *stats,
+		double util, double ops, double secs, double perfindex)
+{
+	FILE *out;
+	int i, k, csv = strlen(path) > 4 && strcmp(path + strlen(path) - 4, ".csv") == 0;
+
+	if ((out = fopen(path, "w")) == NULL)
+		unix_error("Could not open %s in write_results", path);
+	if (csv)
+		fprintf(out, "trace,weight,valid,util,ops,secs,kops,perfindex,trial_secs\n");
+	else
+		fprintf(out, "{\n  \"traces\": [\n");
+	for (i = 0; i < n; i++) {
+		double kops = stats[i].valid && stats[i].secs > 0 ? stats[i].ops / 1e3 / stats[i].secs : 0;
+		if (csv) {
+			write_csv_string(out, stats[i].filename);
+			fprintf(out, ",%d,%d,%.6f,%.0f,%.9f,%.3f,,", stats[i].weight, stats[i].valid, stats[i].util,
+					stats[i].ops, stats[i].secs, kops);
+			for (k = 0; k < stats[i].ntrials; k++)
+				fprintf(out, "%s%.9f", k ? " " : "", stats[i].trial_secs[k]);
+			fprintf(out, "\n");
+			continue;
+		}
+		fprintf(out, "    {\"trace\": ");
+		write_json_string(out, stats[i].filename);
+		fprintf(out, ", \"weight\": %d, \"valid\": %d, \"util\": %.6f, \"ops\": %.0f, "
+				"\"secs\": %.9f, \"kops\": %.3f, \"trial_secs\": [",
+				stats[i].weight, stats[i].valid, stats[i].util,
+				stats[i].ops, stats[i].secs, kops);
+		for (k = 0; k < stats[i].ntrials; k++)
+			fprintf(out, "%s%.9f", k ? ", " : "", stats[i].trial_secs[k]);
+		fprintf(out, "]}%s\n", i < n - 1 ? "," : "");
+	}
+	if (csv)
+		fprintf(out, "total,,%d,%.6f,%.0f,%.9f,%.3f,%.6f,\n", errors == 0, util, ops, secs,
+				secs > 0 ? ops / 1e3 / secs : 0, perfindex);
+	else
+		fprintf(out, "  ],\n  \"total\": {\"valid\": %d, \"util\": %.6f, \"ops\": %.0f, "
+				"\"secs\": %.9f, \"kops\": %.3f, \"perfindex\": %.6f}\n}\n",
+				errors == 0, util, ops, secs, secs > 0 ? ops / 1e3 / secs : 0, perfindex);
+	if (fclose(out) != 0)
+		unix_error("Could not write %s in write_results", path);
+}
+
+/*
+ * read_trials - read the numbers of a list, separated by spaces or
+ *     commas and ended by ']' or the end of the string, into trials
+ */
+static int read_trials(const char *s, double *trials)
+{
+	int n = 0;
+	char *end;
+
+	while (n < MAX_TRIALS) {
+		while (*s == ' ' || *s == ',')
+			s++;
+		trials[n] = strtod(s, &end);
+		if (end == s)
+			break;
+		n++;
+		s = end;
+	}
+	return n;
+}
+
+/*
+ * read_json_string - read the JSON string whose opening quote is at p
+ *     into name, as write_json_string wrote it; return what follows the
+ *     closing quote, or NULL if there is none
+ */
+static const char *read_json_string(const char *p, char *name, int size)
+{
+	int i = 0;
+	unsigned c;
+
+	for (p++; *p != '"'; p++) {
+		if (*p == '\0')
+			return NULL;
+		c = (unsigned char)*p;
+		if (c == '\\') {
+			c = (unsigned char)*++p;
+			if (c == 'u' && sscanf(p + 1, "%4x", &c) == 1)
+				p += 4;
+			else if (c == '\0')
+				return NULL;
+		}
+		if (i < size - 1)
+			name[i++] = c;
+	}
+	name[i] = '\0';
+	return p + 1;
+}
+
+/*
+ * read_csv_string - read the CSV field at the start of line into name,
+ *     as write_csv_string wrote it; a quoted field that goes on past the
+ *     end of line is read on from in into line. Return what follows the
+ *     field, or NULL if a quoted one is never closed
+ */
+static const char *read_csv_string(char *line, int len, FILE *in,
+		char *name, int size)
+{
+	const char *p = line;
+	int i = 0;
+
+	if (*p != '"') {
+		for (; *p && *p != ',' && *p != '\n'; p++)
+			if (i < size - 1)
+				name[i++] = *p;
+		name[i] = '\0';
+		return p;
+	}
+	for (p++; ; p++) {
+		if (*p == '\0') {
+			if (fgets(line, len, in) == NULL)
+				return NULL;
+			p = line;
+		}
+		if (*p == '"' && *++p != '"')
+			break;
+		if (i < size - 1)
+			name[i++] = *p;
+	}
+	name[i] = '\0';
+	return p;
+}
+
+/*
+ * read_baseline - find the results of trace in a file that write_results
+ *     wrote, each trace is on a line of its own; return 0 if it is not there
+ */
+static int read_baseline(const char *path, const char *trace, stats_t *base)
+{
+	FILE *in;
+	char line[4 * MAXLINE], name[MAXLINE];
+	const char *p;
+	int found = 0;
+
+	if ((in = fopen(path, "r")) == NULL)
+		unix_error("Could not open %s in read_baseline", path);
+	memset(base, 0, sizeof(*base));
+	while (!found && fgets(line, sizeof(line), in) != NULL) {
+		if ((p = strstr(line, "{\"trace\": \"")) != NULL) { /* JSON */
+			p = read_json_string(p + strlen("{\"trace\": "), name, MAXLINE);
+			if (p == NULL || strcmp(name, trace) != 0)
+				continue;
+			found = sscanf(p, ", \"weight\": %d, \"valid\": %d, \"util\": %lf, "
+					"\"ops\": %lf, \"secs\": %lf", &base->weight, &base->valid,
+					&base->util, &base->ops, &base->secs) == 5;
+			if (found && (p = strstr(p, "\"trial_secs\": [")) != NULL)
+				base->ntrials = read_trials(p + strlen("\"trial_secs\": ["), base->trial_secs);
+		}
+		else if ((p = read_csv_string(line, sizeof(line), in, name, MAXLINE)) != NULL &&
+				*p == ',' && strcmp(name, trace) == 0) { /* CSV */
+			found = sscanf(p, ",%d,%d,%lf,%lf,%lf", &base->weight, &base->valid,
+					&base->util, &base->ops, &base->secs) == 5;
+			if (found && (p = strrchr(p, ',')) != NULL)
+				base->ntrials = read_trials(p + 1, base->trial_secs);
+		}
+	}
+	fclose(in);
+	if (found && base->ntrials == 0) {
+		base->trial_secs[0] = base->secs;
+		base->ntrials = 1;
+	}
+	return found;
+}
+
+/*
+ * t_crit - the two-sided 5% critical value of Student's t with df
+ *     degrees of freedom
+ */
+static double t_crit(double df)
+{
+	static const double t975[] = {
+		12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+		2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+		2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042 };
+
+	if (df < 1)
+		df = 1;
+	if (df <= 30)
+		return t975[(int)df - 1];
+	return df <= 40 ? 2.021 : df <= 60 ? 2.000 : df <= 120 ? 1.980 : 1.960;
+}
+
+/*
+ * mean_var - the mean and sample variance of n values
+ */
+static void mean_var(const double *v, int n, double *mean, double *var)
+{
+	double sum = 0, sq = 0;
+
+	for (int i = 0; i < n; i++)
+		sum += v[i];
+	*mean = sum / n;
+	for (int i = 0; i < n; i++)
+		sq += (v[i] - *mean) * (v[i] - *mean);
+	*var = n > 1 ? sq / (n - 1) : 0;
+}
+
+/*
+ * compare_results - compare the secs and util of each trace with those
+ *     saved in path. A change in secs is significant if Welch's t test
+ *     over the timed runs on both sides rejects equal means at 5%, and
+ *     fails the comparison if it is a slowdown of more than regress_pct;
+ *     util is deterministic and fails if it drops by more than that.
+ *     Return the number of traces that failed.
+ */
+static int compare_results(const char *path, int n, stats_t *stats)
+{
+	int i, failed = 0;
+	stats_t base;
+
+	printf("Compared with %s, %.1f%% slower or less utilized fails:\n", path, regress_pct);
+	printf("%10s%10s%8s%8s%7s%7s  %-9s %s\n",
+			"base Kops", "Kops", "change", "t", "b util", "util", "verdict", "trace");
+	for (i = 0; i < n; i++) {
+		double mb, vb, mc, vc, se, t, change;
+		const char *verdict;
+		int fail;
+
+		if (!read_baseline(path, stats[i].filename, &base)) {
+			printf("%10s%10s%8s%8s%7s%7s  %-9s %s\n",
+					"-", "-", "-", "-", "-", "-", "new", stats[i].filename);
+			continue;
+		}
+		if (!stats[i].valid || !base.valid) {
+			verdict = stats[i].valid ? "fixed" : "INVALID";
+			failed += !stats[i].valid;
+			printf("%10s%10s%8s%8s%7s%7s  %-9s %s\n",
+					"-", "-", "-", "-", "-", "-", verdict, stats[i].filename);
+			continue;
+		}
+
+		mean_var(base.trial_secs, base.ntrials, &mb, &vb);
+		mean_var(stats[i].trial_secs, stats[i].ntrials, &mc, &vc);
+		change = (mc / mb - 1) * 100;
+		se = sqrt(vb / base.ntrials + vc / stats[i].ntrials);
+		if (se > 0)
+			t = (mc - mb) / se;
+		else
+			t = mc == mb ? 0 : mc > mb ? INFINITY : -INFINITY;
+
+		if (base.ntrials < 2 || stats[i].ntrials < 2) {
+			/* no variance to test against, the threshold alone decides */
+			verdict = change > regress_pct ? "SLOWER?" : change < -regress_pct ? "faster?" : "same?";
+			fail = change > regress_pct;
+		}
+		else {
+			double df = se > 0 ? pow(se, 4) /
+				(pow(vb / base.ntrials, 2) / (base.ntrials - 1) +
+				 pow(vc / stats[i].ntrials, 2) / (stats[i].ntrials - 1)) : 1e9;
+			int significant = fabs(t) > t_crit(df);
+			verdict = !significant ? "same" :
+				change > regress_pct ? "SLOWER" :
+				change > 0 ? "slower" : "faster";
+			fail = significant && change > regress_pct;
+		}
+		if (stats[i].util < base.util * (1 - regress_pct / 100)) {
+			verdict = fail ? "SLOW+UTIL" : "UTIL";
+			fail = 1;
+		}
+		failed += fail;
+		printf("%10.0f%10.0f%7.1f%%%8.2f%6.0f%%%6.0f%%  %-9s %s\n",
+				base.ops / 1e3 / mb, stats[i].ops / 1e3 / mc, change, t,
+				base.util * 100, stats[i].util * 100, verdict, stats[i].filename);
+	}
+	printf("%d trace%s failed\n\n", failed, failed == 1 ? "" : "s");
+	return failed;
+}
+
+/*
+ * printfaults - prints the page faults and cycles per op of each trace
+ *     on a cold heap, the cycles per op on a warm one, and the heap
+ *     bytes in transparent huge pages
+ */
+static void printfaults(int n, stats_t *stats)
+{
+	int i;
+
+	printf("%10s%10s%10s%10s  %s\n",
+			"faults", "cold cyc", "warm cyc", "thp KB", "trace");
+	for (i=0; i < n; i++) {
+		if (!stats[i].valid)
+			continue;
+		printf("%10ld%10.1f%10.1f%10zu  %s\n",
+				stats[i].faults,
+				stats[i].cold_cpo,
+				stats[i].warm_cpo,
+				stats[i].thp / 1024,
+				stats[i].filename);
+	}
+}
+
+/*
+ * printoverhead - prints the time per op of the replay loop alone and
+ *     with mm, and the mm throughput with the loop's time taken out
+ */
+static void printoverhead(int n, stats_t *stats)
+{
+	int i;
+
+	printf("%10s%10s%10s%10s%10s  %s\n",
+			"ops", "loop ns", "mm ns", "Kops", "net Kops", "trace");
+	for (i=0; i < n; i++) {
+		double net;
+		if (!stats[i].valid || stats[i].ops == 0)
+			continue;
+		net = stats[i].secs - stats[i].null_secs;
+		printf("%10.0f%10.1f%10.1f%10.0f%10.0f  %s\n",
+				stats[i].ops,
+				stats[i].null_secs / stats[i].ops * 1e9,
+				stats[i].secs / stats[i].ops * 1e9,
+				stats[i].secs > 0 ? stats[i].ops / stats[i].secs / 1e3 : 0,
+				net > 0 ? stats[i].ops / net / 1e3 : 0,
+				stats[i].filename);
+	}
+}
+
+/*
+ * printperf - prints the Kops of each trace and the counts per op of
+ *     every counter that was opened, "-" for one that couldn't be read
+ */
+static void printperf(int n, stats_t *stats)
+{
+	int i, c;
+
+	printf("%10s", "Kops");
+	for (c = 0; c < perf.n; c++)
+		printf("%10s", perf.name[c]);
+	printf("  %s\n", "trace");
+	for (i=0; i < n; i++) {
+		if (!stats[i].valid)
+			continue;
+		printf("%10.0f", stats[i].secs > 0 ? stats[i].ops / stats[i].secs / 1e3 : 0);
+		for (c = 0; c < perf.n; c++) {
+			if (stats[i].perf[c] < 0)
+				printf("%10s", "-");
+			else
+				printf("%10.2f", stats[i].perf[c]);
+		}
+		printf("  %s\n", stats[i].filename);
+	}
+}
+
+/*
+ * printmmstats - prints the allocator counters of each trace, and
+ *     the free lists that were ever used
+ */
+static void printmmstats(int n, stats_t *stats)
+{
+	int i, l;
+
+	for (i=0; i < n; i++) {
+		mm_stats_t *s = stats[i].mm;
+
+		if (!stats[i].valid)
+			continue;
+		printf("Allocator stats for %s:\n", stats[i].filename);
+		if (s == NULL) {
+			printf("  not kept, build mm.c with -DMM_STATS (make STATS=1)\n\n");
+			continue;
+		}
+		printf("  calls     malloc %lu  free %lu  realloc %lu  calloc %lu  memalign %lu\n",
+				s->malloc_calls, s->free_calls, s->realloc_calls, s->calloc_calls,
+				s->memalign_calls);
+		printf("  bytes     requested %lu  allocated %lu (%.1f%% overhead)\n",
+				s->bytes_requested, s->bytes_allocated,
+				s->bytes_requested ?
+				100.0 * (s->bytes_allocated - s->bytes_requested) / s->bytes_requested : 0);
+		printf("  tcache    hits %lu\n", s->tcache_hits);
+		printf("  find_fit  visits %lu  splits %lu\n", s->fit_visits, s->splits);
+		printf("  coalesce  none %lu  next %lu  prev %lu  both %lu\n",
+				s->coalesce[0], s->coalesce[1], s->coalesce[2], s->coalesce[3]);
+		printf("  extend    calls %lu  bytes %lu\n", s->extend_calls, s->extend_bytes);
+		printf("  trim      calls %lu  bytes %lu\n", s->trim_calls, s->trim_bytes);
+		printf("  huge      maps %lu  remaps %lu\n", s->huge_maps, s->huge_remaps);
+		printf("  calloc    bytes %lu  cleared %lu\n", s->calloc_bytes, s->calloc_cleared);
+		printf("%8s%10s%14s%14s\n", "list", "hits", "free-bytes", "peak-free");
+		for (l = 0; l < s->nlists; l++) {
+			if (s->list_hits[l] == 0 && s->peak_free_bytes[l] == 0)
+				continue;
+			printf("%8d%10lu%14lu%14lu\n", l, s->list_hits[l],
+					s->free_bytes[l], s->peak_free_bytes[l]);
+		}
+		printf("\n");
+	}
+}
+
+/*
+ * printslabgains - prints utilization and throughput of each trace
+ *     with the slab engine off and on
+ */
+static void printslabgains(int n, stats_t *off, stats_t *on)
+{
+	int i;
+
+	printf("%9s%9s%11s%11s%9s  %s\n",
+			"util-off", "util-on", "Kops-off", "Kops-on", "speedup", "trace");
+	for (i=0; i < n; i++) {
+		if (off[i].valid && on[i].valid) {
+			double kops_off = (off[i].ops/1e3)/off[i].secs;
+			double kops_on = (on[i].ops/1e3)/on[i].secs;
+			printf("%8.0f%%%8.0f%%%11.0f%11.0f%8.2fx  %s\n",
+					off[i].util*100.0,
+					on[i].util*100.0,
+					kops_off,
+					kops_on,
+					kops_on/kops_off,
+					on[i].filename);
+		}
+		else {
+			printf("%9s%9s%11s%11s%9s  %s\n",
+					"-", "-", "-", "-", "-", on[i].filename);
+		}
+	}
+}
+
 /*
  * app_error - Report an arbitrary application error
  */
@@ -1418,4 +3086,25 @@ static void usage(void)
 	fprintf(stderr, "\t-s <s>     Timeout after s secs (default no timeout)\n");
 	fprintf(stderr, "\t-f <file>  Use <file> as the trace file.\n");
 	fprintf(stderr, "\t-j         Use <stdin> as the trace file.\n");
+	fprintf(stderr, "\t-L         Measure the latency of every request, print percentiles.\n");
+	fprintf(stderr, "\t-w         Print the worst-case cycles of each request type.\n");
+	fprintf(stderr, "\t-M         Print the allocator counters (mm.c built with STATS=1).\n");
+	fprintf(stderr, "\t-E         Also check each trace in a heap of its own (mm_heap_create).\n");
+	fprintf(stderr, "\t-R         Report heap size and resident bytes after each trace.\n");
+	fprintf(stderr, "\t-F         Report page faults and cycles per op on a cold and warm heap.\n");
+	fprintf(stderr, "\t-G <n>[,json] Sample live bytes, heap size and free blocks every <n> ops,\n");
+	fprintf(stderr, "\t           write them to <trace>.frag.csv (or .json) in this directory.\n");
+	fprintf(stderr, "\t-W <n>     Timed runs write the first <n> bytes of each payload and read\n");
+	fprintf(stderr, "\t           them back before free and realloc (0: the whole payload).\n");
+	fprintf(stderr, "\t-P         Count instructions, cache, TLB and branch misses and page faults\n");
+	fprintf(stderr, "\t           per op with perf_event_open.\n");
+	fprintf(stderr, "\t-O         Time the replay loop with a null allocator, print Kops without it.\n");
+	fprintf(stderr, "\t-T         Back the heap with transparent huge pages.\n");
+	fprintf(stderr, "\t-H <n>     Map requests of <n> bytes or more on their own (0: never).\n");
+	fprintf(stderr, "\t-S         Also run with the slab engine on and print the gains.\n");
+	fprintf(stderr, "\t-n <k>     Time each trace <k> times, report the median (default 1).\n");
+	fprintf(stderr, "\t-o <file>  Write the results to <file> as JSON, or CSV if it ends in .csv.\n");
+	fprintf(stderr, "\t-b <file>  Compare with the results in <file> from -o, -n 5 by default,\n");
+	fprintf(stderr, "\t           exit 1 if a trace is significantly slower or less utilized.\n");
+	fprintf(stderr, "\t-x <pct>   Slowdown or util loss in percent that fails -b (default 5).\n");
 }
\ No newline at end of file
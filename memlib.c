@@ -3,6 +3,7 @@
  *						allows us to interleave calls from the student's malloc package 
  *						with the system's malloc package in libc.
  */
+#define _GNU_SOURCE /* mremap */
 #include <stdio.h>
 #include <stdlib.h>
 #include <assert.h>
@@ -10,82 +11,518 @@
 #include <sys/mman.h>
 #include <string.h>
 #include <errno.h>
-#include <fcntl.h>
 
 #include "memlib.h"
 #include "config.h"
 
+/*
+ * A heap is a reserved range of address space with a brk in it. The one
+ * behind mem_init and mem_sbrk is mem_default_heap; mem_heap_create makes
+ * more, each keeping its own struct in its first page.
+ */
+struct mem_heap {
+	char *heap;
+	char *brk;
+	char *max_addr;
+	char *commit;   /* end of the read/write part of the heap */
+	char *peak_brk; /* highest brk since mem_reset_brk */
+	char *clean;    /* heap bytes from here on have never been handed out */
+	mem_heap_t *next; /* next heap from mem_heap_create, in the driver */
+};
+
 /* private variables */
-static char *heap;
-static char *mem_brk;
-static char *mem_max_addr;
+static mem_heap_t mem_default_heap;
+static size_t mem_mapped_bytes; /* bytes in mem_map regions */
+static size_t mem_peak;    /* most heap and mapped bytes since mem_reset_brk */
+
+#ifndef MM_PRELOAD
+/* The driver keeps a record of the mem_map regions, to check payloads
+   against them and to unmap what a trace leaves behind, sorted on lo */
+typedef struct {
+	char *lo;
+	size_t len;
+} mapping_t;
+static mapping_t *maps;
+static int nmaps, maxmaps;
+static mem_heap_t *heaps; /* from mem_heap_create, for mem_contains */
+#endif
+
+/*
+ * mem_footprint - note the bytes in use, heap and mapped, for mem_heap_peak
+ */
+static void mem_footprint(void)
+{
+	mem_heap_t *m = &mem_default_heap;
+	size_t bytes = (m->brk - m->heap) + mem_mapped_bytes;
+	if (bytes > mem_peak)
+		mem_peak = bytes;
+}
+
+/*
+ * mem_release - give the whole pages in [lo, hi) back to the OS, they
+ *     read as zero when touched again
+ */
+static void mem_release(mem_heap_t *m, char *lo, char *hi)
+{
+	size_t page = getpagesize();
+	lo = m->heap + ((lo - m->heap + page - 1) & ~(page - 1));
+	hi = m->heap + ((hi - m->heap + page - 1) & ~(page - 1));
+	if (lo < hi) {
+		madvise(lo, hi - lo, MADV_DONTNEED);
+		if (hi >= m->clean && lo < m->clean)
+			m->clean = lo;
+	}
+}
+
+/*
+ * mem_move_brk - move the brk by incr bytes, either way, after the
+ *     caller has checked the new brk is in [m->heap, m->max_addr]
+ */
+static void *mem_move_brk(mem_heap_t *m, intptr_t incr)
+{
+	char *old_brk = m->brk;
+
+	m->brk += incr;
+	if (incr < 0)
+		mem_release(m, m->brk, old_brk);
+	else if (m->brk > m->peak_brk) {
+		m->peak_brk = m->brk;
+		if (m->brk > m->clean)
+			m->clean = m->brk;
+	}
+	if (m == &mem_default_heap)
+		mem_footprint();
+	return (void *)old_brk;
+}
+
+/*
+ * The heap is MAX_HEAP bytes of address space reserved with no access.
+ * mem_sbrk makes them read/write COMMIT_CHUNK bytes at a time as the brk
+ * passes m->commit, so a large MAX_HEAP costs nothing until it is used.
+ * In libmm.so nothing here may call malloc, so errors are not printed.
+ */
+#define COMMIT_CHUNK (1 << 20)
+
+/*
+ * With mem_set_thp(1) before mem_init, the default heap starts on a
+ * THP_SIZE boundary, is madvised MADV_HUGEPAGE and is committed THP_SIZE
+ * at a time, so the kernel can back it with transparent huge pages.
+ */
+#define THP_SIZE (2 << 20)
+static int mem_thp;
+
+#ifdef MM_PRELOAD
+#define HEAP_HINT NULL
+#else
+#define HEAP_HINT ((void *)0x800000000) /* suggested start */
+#endif
 
 /* 
  * mem_init - initialize the memory system model
  */
 void mem_init(void){
-	int dev_zero = open("/dev/zero", O_RDWR);
-	heap = mmap((void *)0x800000000, /* suggested start*/
-			MAX_HEAP,				/* length */
-			PROT_WRITE,				/* permissions */
-			MAP_PRIVATE,			/* private or shared? */
-			dev_zero,				/* fd */
-			0);						/* offset (dunno) */
-	mem_max_addr = heap + MAX_HEAP;
-	mem_brk = heap;					/* heap is empty initially */
+	mem_heap_t *m = &mem_default_heap;
+	size_t slack = mem_thp ? THP_SIZE : 0;
+
+	m->heap = mmap(HEAP_HINT, MAX_HEAP + slack, PROT_NONE,
+			MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	if (m->heap == MAP_FAILED)
+		m->heap = NULL;
+	else if (mem_thp) {
+		/* keep the THP_SIZE aligned MAX_HEAP bytes, unmap the rest */
+		char *lo = (char *)(((unsigned long)m->heap + THP_SIZE - 1) & ~(unsigned long)(THP_SIZE - 1));
+		if (lo > m->heap)
+			munmap(m->heap, lo - m->heap);
+		if (lo < m->heap + slack)
+			munmap(lo + MAX_HEAP, m->heap + slack - lo);
+		m->heap = lo;
+		madvise(m->heap, MAX_HEAP, MADV_HUGEPAGE);
+	}
+	m->max_addr = m->heap ? m->heap + MAX_HEAP : NULL;
+	m->brk = m->commit = m->peak_brk = m->clean = m->heap;	/* heap is empty initially */
 }
 
 /* 
  * mem_deinit - free the storage used by the memory system model
  */
 void mem_deinit(void){
-	munmap(heap, MAX_HEAP);
+	if (mem_default_heap.heap)
+		munmap(mem_default_heap.heap, MAX_HEAP);
+}
+
+/*
+ * mem_set_thp - ask for transparent huge pages for the heap of the next
+ *		mem_init, if on
+ */
+void mem_set_thp(int on){
+	mem_thp = on;
+}
+
+/*
+ * mem_heap_create - reserve another heap of up to max bytes, empty and
+ *		independent of the default one, return NULL if it can't be had
+ */
+mem_heap_t *mem_heap_create(size_t max){
+	size_t page = getpagesize();
+	char *base;
+	mem_heap_t *m;
+
+	if (max > MAX_HEAP) {
+		errno = ENOMEM;
+		return NULL;
+	}
+	max = (max + page - 1) & ~(page - 1);
+	base = mmap(NULL, page + max, PROT_NONE,
+			MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	if (base == MAP_FAILED)
+		return NULL;
+	if (mprotect(base, page, PROT_READ | PROT_WRITE) < 0) {
+		munmap(base, page + max);
+		return NULL;
+	}
+	m = (mem_heap_t *)base;
+	m->heap = base + page;
+	m->max_addr = m->heap + max;
+	m->brk = m->commit = m->peak_brk = m->clean = m->heap;
+#ifndef MM_PRELOAD
+	m->next = heaps;
+	heaps = m;
+#endif
+	return m;
+}
+
+/*
+ * mem_heap_destroy - unmap a heap from mem_heap_create and everything in it
+ */
+void mem_heap_destroy(mem_heap_t *m){
+	char *base = (char *)m;
+#ifndef MM_PRELOAD
+	mem_heap_t **pp = &heaps;
+	while (*pp != NULL && *pp != m)
+		pp = &(*pp)->next;
+	if (*pp != NULL)
+		*pp = m->next;
+#endif
+	munmap(base, m->max_addr - base);
+}
+
+/*
+ * mem_default - return the heap that mem_sbrk works on
+ */
+mem_heap_t *mem_default(void){
+	return &mem_default_heap;
 }
 
 /*
  * mem_reset_brk - reset the simulated brk pointer to make an empty heap
  */
 void mem_reset_brk(){
-	mem_brk = heap;
+	mem_heap_t *m = &mem_default_heap;
+
+	m->brk = m->peak_brk = m->heap;
+#ifndef MM_PRELOAD
+	while (nmaps > 0)
+		mem_unmap(maps[nmaps - 1].lo, maps[nmaps - 1].len);
+#endif
+	mem_peak = 0;
+}
+
+/*
+ * mem_commit_to - make the heap read/write up to brk, return -1 if it can't
+ */
+static int mem_commit_to(mem_heap_t *m, char *brk)
+{
+	size_t chunk = mem_thp && m == &mem_default_heap ? THP_SIZE : COMMIT_CHUNK;
+	char *commit;
+
+	if (brk <= m->commit)
+		return 0;
+	commit = m->heap + ((brk - m->heap + chunk - 1) & ~(chunk - 1));
+	if (commit > m->max_addr)
+		commit = m->max_addr;
+	if (mprotect(m->commit, commit - m->commit, PROT_READ | PROT_WRITE) < 0)
+		return -1;
+	m->commit = commit;
+	return 0;
 }
 
 /* 
  * mem_sbrk - simple model of the sbrk function. Extends the heap 
- *		by incr bytes and returns the start address of the new area. In
- *		this model, the heap cannot be shrunk.
+ *		by incr bytes and returns the start address of the new area.
+ *		A negative incr shrinks the heap and gives its pages back.
  */
-void *mem_sbrk(int incr) {
-	char *old_brk = mem_brk;
+void *mem_sbrk(intptr_t incr) {
+	return mem_heap_sbrk(&mem_default_heap, incr);
+}
 
-	if ( (incr < 0) || ((mem_brk + incr) > mem_max_addr)) {
+/*
+ * mem_heap_sbrk - mem_sbrk on heap m
+ */
+void *mem_heap_sbrk(mem_heap_t *m, intptr_t incr) {
+	if ( (m->heap == NULL) || (incr > m->max_addr - m->brk) || (incr < m->heap - m->brk) ||
+			mem_commit_to(m, m->brk + incr) < 0) {
 		errno = ENOMEM;
-		fprintf(stderr, "ERROR: mem_sbrk failed. Ran out of memory...\n");
+#ifndef MM_PRELOAD
+		if (m == &mem_default_heap)
+			fprintf(stderr, "ERROR: mem_sbrk failed. Ran out of memory...\n");
+#endif
 		return (void *)-1;
 	}
-	mem_brk += incr;
-	return (void *)old_brk;
+	return mem_move_brk(m, incr);
+}
+
+#ifndef MM_PRELOAD
+/*
+ * mapping_index - the index of the last mapping starting at or below p, -1 if none
+ */
+static int mapping_index(const char *p){
+	int lo = 0, hi = nmaps - 1;
+
+	while (lo <= hi) {
+		int mid = (lo + hi) / 2;
+		if (maps[mid].lo <= p)
+			lo = mid + 1;
+		else
+			hi = mid - 1;
+	}
+	return hi;
+}
+
+/*
+ * find_mapping - the record of the mapping holding p, or NULL
+ */
+static mapping_t *find_mapping(const char *p){
+	int i = mapping_index(p);
+	return i >= 0 && p < maps[i].lo + maps[i].len ? &maps[i] : NULL;
+}
+
+/*
+ * add_mapping - record the region of len bytes at p, in order
+ */
+static void add_mapping(char *p, size_t len){
+	int i;
+
+	if (nmaps == maxmaps) {
+		maxmaps = maxmaps ? 2 * maxmaps : 64;
+		if ((maps = realloc(maps, maxmaps * sizeof(*maps))) == NULL) {
+			fprintf(stderr, "ERROR: mem_map failed to record a mapping\n");
+			exit(1);
+		}
+	}
+	i = mapping_index(p) + 1;
+	memmove(&maps[i + 1], &maps[i], (nmaps - i) * sizeof(*maps));
+	maps[i].lo = p;
+	maps[i].len = len;
+	nmaps++;
+}
+
+/*
+ * remove_mapping - forget the record m
+ */
+static void remove_mapping(mapping_t *m){
+	memmove(m, m + 1, (&maps[nmaps] - (m + 1)) * sizeof(*maps));
+	nmaps--;
+}
+#endif
+
+/*
+ * mem_map - map a region of len bytes, a multiple of the page size,
+ *		apart from the heap, return NULL if it can't be had
+ */
+void *mem_map(size_t len){
+	char *p;
+
+	if (len > MAX_HEAP - mem_mapped_bytes) {
+		errno = ENOMEM;
+		return NULL;
+	}
+	p = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (p == MAP_FAILED)
+		return NULL;
+#ifndef MM_PRELOAD
+	add_mapping(p, len);
+	mem_mapped_bytes += len;
+	mem_footprint();
+#endif
+	return p;
+}
+
+/*
+ * mem_unmap - unmap the region of len bytes at p made by mem_map, return
+ *		-1 and leave it alone if the driver has no such region
+ */
+int mem_unmap(void *p, size_t len){
+#ifndef MM_PRELOAD
+	mapping_t *m = find_mapping(p);
+	if (m == NULL || m->lo != p || m->len != len) {
+		errno = EINVAL;
+		return -1;
+	}
+	remove_mapping(m);
+	mem_mapped_bytes -= len;
+#endif
+	return munmap(p, len);
+}
+
+/*
+ * mem_remap - resize the region of old_len bytes at p made by mem_map to
+ *		new_len. The pages are moved, not copied, if it can't grow in place.
+ *		Return the region's new address, or NULL and leave it as it was.
+ */
+void *mem_remap(void *p, size_t old_len, size_t new_len){
+	char *q;
+
+	if (new_len > old_len && new_len - old_len > MAX_HEAP - mem_mapped_bytes) {
+		errno = ENOMEM;
+		return NULL;
+	}
+	q = mremap(p, old_len, new_len, MREMAP_MAYMOVE);
+	if (q == MAP_FAILED)
+		return NULL;
+#ifndef MM_PRELOAD
+	mapping_t *m = find_mapping(p);
+	if (m) {
+		remove_mapping(m);
+		add_mapping(q, new_len);
+		mem_mapped_bytes += new_len - old_len;
+		mem_footprint();
+	}
+#endif
+	return q;
+}
+
+/*
+ * mem_contains - is [lo, hi] inside the heap, one mem_map region,
+ *		or a heap from mem_heap_create?
+ */
+int mem_contains(void *lo, void *hi){
+	if ((char *)lo >= mem_default_heap.heap && (char *)hi < mem_default_heap.brk)
+		return 1;
+#ifndef MM_PRELOAD
+	for (mem_heap_t *h = heaps; h != NULL; h = h->next)
+		if ((char *)lo >= h->heap && (char *)hi < h->brk)
+			return 1;
+	mapping_t *m = find_mapping(lo);
+	return m && (char *)hi < m->lo + m->len;
+#else
+	return 0;
+#endif
+}
+
+/*
+ * mem_decommit - give back every page of the heap mapping, so that the
+ *		next trace starts with nothing resident
+ */
+void mem_decommit(void){
+	mem_heap_t *m = &mem_default_heap;
+
+	if (m->heap)
+		mem_release(m, m->heap, m->commit);
+}
+
+/*
+ * mem_heap_clean - return the address from which heap m reads as zero:
+ *		memory mem_heap_sbrk hands out above it has not been written
+ *		since it was mapped or given back to the OS
+ */
+void *mem_heap_clean(mem_heap_t *m){
+	return (void *)m->clean;
 }
 
 /*
  * mem_heap_lo - return address of the first heap byte
  */
 void *mem_heap_lo(){
-	return (void *)heap;
+	return (void *)mem_default_heap.heap;
 }
 
 /* 
  * mem_heap_hi - return address of last heap byte
  */
 void *mem_heap_hi(){
-	return (void *)(mem_brk - 1);
+	return (void *)(mem_default_heap.brk - 1);
 }
 
 /*
  * mem_heapsize() - returns the heap size in bytes
  */
 size_t mem_heapsize() {
-	return (size_t)((void *)mem_brk - (void *)heap);
+	return (size_t)(mem_default_heap.brk - mem_default_heap.heap);
+}
+
+/*
+ * mem_mapped() - returns the bytes in mem_map regions
+ */
+size_t mem_mapped() {
+	return mem_mapped_bytes;
+}
+
+/*
+ * mem_heap_peak() - returns the most bytes of heap and mem_map regions
+ *		in use at once since mem_reset_brk
+ */
+size_t mem_heap_peak() {
+	return mem_peak;
+}
+
+/*
+ * resident - returns the bytes of the pages in [lo, lo + len) that are
+ *		resident in memory
+ */
+static size_t resident(char *lo, size_t len) {
+	size_t page = getpagesize();
+	size_t n = (len + page - 1) / page, rss = 0;
+	unsigned char vec[4096];
+
+	for (size_t i = 0; i < n; i += sizeof(vec)) {
+		size_t m = n - i < sizeof(vec) ? n - i : sizeof(vec);
+		if (mincore(lo + i * page, m * page, vec) < 0)
+			return 0;
+		for (size_t j = 0; j < m; j++)
+			rss += (vec[j] & 1) * page;
+	}
+	return rss;
+}
+
+/*
+ * mem_heap_rss() - returns the bytes of heap pages resident in memory,
+ *		up to the peak brk, and of mem_map regions
+ */
+size_t mem_heap_rss() {
+	mem_heap_t *m = &mem_default_heap;
+	size_t rss = resident(m->heap, m->peak_brk - m->heap);
+#ifndef MM_PRELOAD
+	for (int i = 0; i < nmaps; i++)
+		rss += resident(maps[i].lo, maps[i].len);
+#endif
+	return rss;
+}
+
+#ifndef MM_PRELOAD
+/*
+ * mem_heap_thp() - returns the bytes of the heap backed by transparent
+ *		huge pages, from AnonHugePages in /proc/self/smaps
+ */
+size_t mem_heap_thp() {
+	mem_heap_t *m = &mem_default_heap;
+	char line[256];
+	unsigned long lo, hi;
+	size_t kb, thp = 0;
+	int in_heap = 0;
+	FILE *f;
+
+	if ((f = fopen("/proc/self/smaps", "r")) == NULL)
+		return 0;
+	while (fgets(line, sizeof(line), f)) {
+		if (sscanf(line, "%lx-%lx ", &lo, &hi) == 2)
+			in_heap = (char *)lo < m->brk && (char *)hi > m->heap;
+		else if (in_heap && sscanf(line, "AnonHugePages: %zu kB", &kb) == 1)
+			thp += kb * 1024;
+	}
+	fclose(f);
+	return thp;
 }
+#endif
 
 /*
  * mem_pagesize() - returns the page size of the system
@@ -1,11 +1,28 @@
 #include <unistd.h>
 
+typedef struct mem_heap mem_heap_t;
+
 void mem_init(void);               
+void mem_set_thp(int on);
 void mem_deinit(void);
-void *mem_sbrk(int incr);
+void *mem_sbrk(intptr_t incr);
+mem_heap_t *mem_heap_create(size_t max);
+void mem_heap_destroy(mem_heap_t *m);
+mem_heap_t *mem_default(void);
+void *mem_heap_sbrk(mem_heap_t *m, intptr_t incr);
 void mem_reset_brk(void); 
+void mem_decommit(void);
+void *mem_map(size_t len);
+int mem_unmap(void *p, size_t len);
+void *mem_remap(void *p, size_t old_len, size_t new_len);
+int mem_contains(void *lo, void *hi);
+void *mem_heap_clean(mem_heap_t *m);
 void *mem_heap_lo(void);
 void *mem_heap_hi(void);
 size_t mem_heapsize(void);
+size_t mem_heap_peak(void);
+size_t mem_mapped(void);
+size_t mem_heap_rss(void);
+size_t mem_heap_thp(void);
 size_t mem_pagesize(void);
 
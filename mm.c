@@ -16,6 +16,12 @@
     ===       bp        === 
     ===      block      ===
 
+    Headers, footers and the succ/prev links are words of WSIZE bytes,
+    the links hold offsets from heap_listp. Words are 32 bit, which keeps
+    a block under 4 GB and the heap within 4 GB of heap_listp. Built with
+    -DMM_WIDE they are 64 bit, so blocks and heap may be larger, at the
+    price of 4 more bytes per allocated block and 16 more per free block.
+
     The structure of free list:
 
     I have MAXLIST size of free_list
@@ -27,15 +33,111 @@
     (2) remove_bp (void *bp): remove bp from the free list it size match
     (3) put_bp (void *bp): put bp on the free list it size match
 
+    free_map has bit i set iff free_list[i] is not empty, put_bp and remove_bp
+    keep it up to date, so find_fit get next non-empty list by find-first-set
+
+    Built with -DTLSF, the free lists follow Two-Level Segregated Fit instead:
+    first level fl is the power of two of size, second level sl splits it
+    linearly into SL_COUNT lists, free_list[fl * SL_COUNT + sl].
+    Sizes below (1 << FL_SHIFT) are fl 0, split by DSIZE.
+    fl_map has bit fl set iff sl_map[fl] != 0, sl_map[fl] has bit sl set
+    iff the list is not empty. find_fit rounds asize up to the next list
+    so that any block on a list found is large enough, and finds it with
+    two find-first-set, so malloc and free never walk a list.
+
+    The thread cache:
+
+    Each thread keeps TC_CLASSES singly linked lists of recently freed blocks,
+    one for every block size up to TC_MAXSIZE. The blocks stay allocated in
+    the heap, so malloc/free of small blocks usually never touch heap_listp,
+    epilogue or free_head. An empty list is refilled with TC_BATCH blocks and
+    a full list flushes TC_BATCH blocks back, both while holding the heap lock.
+    Build with -DMM_THREADS to make the heap lock a real mutex. The cache is
+    only built with it (libmm.so, mtdriver): cached blocks can't coalesce, so
+    without threads to save the lock for it only costs utilization.
+
+    The slab engine:
+
+    Requests up to SLAB_MAXSIZE bytes are rounded to a multiple of 8 and
+    served from runs. A run is an allocated block of RUN_SIZE bytes whose bp
+    is RUN_SIZE aligned, carved from a free block or from extend_heap.
+
+    === run_t  (88 byte) === (next, prev, osize, nobj, nfree, cls, map)
+    ===    objects      === nobj slots of osize bytes, no header or footer
+    === footer (4 byte) ===
+
+    Bit i of map is set iff slot i is free, so malloc and free are a bit scan.
+    slab_map has one bit per heap page which is set for the first page of a
+    run, so free can tell a slab object from a block without a header.
+    Runs with a free slot are kept on slab_partial[cls], an empty run goes
+    back to the heap unless it is the only one left for its class.
+    The engine is off unless mm_set_slab turns it on (MM_SLAB in the
+    environment for libmm.so): a run of 4K for a handful of live objects of
+    a class costs more utilization than the missing headers save.
+
+    Huge blocks:
+
+    Requests of huge_threshold bytes or more (HUGE_THRESHOLD unless set by
+    mm_set_huge) skip the heap and get a region of whole pages of their own
+    from mem_map. The region starts with HUGE_HDR bytes: a magic word made
+    from the payload address, then the region's length. A huge payload
+    sits HUGE_HDR past a page boundary, outside the heap, after its magic
+    word, which is how free tells it from a block and from a pointer that
+    was never ours. free unmaps
+    it at once and realloc resizes it with mem_remap, which moves pages
+    instead of copying them. Huge blocks are never on the free lists.
+
+    Known-zero blocks:
+
+    Memory from mem_sbrk above mem_heap_clean() reads as zero. extend_heap
+    marks such a free block with the ZERO bit in its header and footer and
+    keeps in its third word, CLEAN(bp), the offset from which it reads zero
+    up to its footer; the links and CLEAN itself are the dirty bytes before.
+    coalesce keeps the mark if the last of the merged blocks has it, with
+    the blocks before it counted as dirty, and place() passes it on to the
+    part it splits off. Any other write of a free block header drops it.
+    place() leaves in place_dirty how many bytes of the block it allocated
+    may not be zero, so calloc only clears those.
+
+    Trimming:
+
+    When free leaves a free block of trim_threshold bytes or more just
+    before the epilogue, all but TRIM_PAD bytes of it go back to memlib
+    with a negative mem_sbrk, which drops their pages. trim_threshold
+    starts at TRIM_THRESHOLD and doubles, up to TRIM_MAX, whenever the
+    heap has to grow again after such a trim, so a trace that keeps
+    freeing and reallocating the end of heap soon stops trimming.
+    mm_trim(pad) trims on demand, keeping pad bytes.
+
+    Heaps:
+
+    Everything the free lists and trimming need is a struct mm_heap, and
+    the code above works on H, the heap of the calling thread's current
+    call. H is default_heap, which malloc and friends use, except inside
+    the mm_heap_* functions, which switch it to their heap with ENTER
+    and back with LEAVE while they hold that heap's lock. H is thread
+    local only in MM_THREADS builds. mm_heap_create makes a heap in a
+    memlib heap of its own, and puts its struct there too, so
+    mm_heap_destroy drops all of it with one munmap and no free of each
+    block. These heaps only use the free lists: the thread cache,
+    slab engine and huge blocks belong to the default heap. Each heap has
+    its own counters, mm_heap_get_stats reads them.
+
  */
 #include <assert.h>
+#include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include <sys/mman.h>
+#ifdef MM_THREADS
+#include <pthread.h>
+#endif
 
 #include "mm.h"
 #include "memlib.h"
+#include "config.h"
 
 /* If you want debugging output, use the following macro.  When you hand
  * in, remove the #define DEBUG line. */
@@ -54,6 +156,11 @@
 #define free mm_free
 #define realloc mm_realloc
 #define calloc mm_calloc
+#define memalign mm_memalign
+#define posix_memalign mm_posix_memalign
+#define aligned_alloc mm_aligned_alloc
+#define malloc_usable_size mm_malloc_usable_size
+#define reallocarray mm_reallocarray
 #endif /* def DRIVER */
 
 /* single word (4) or double word (8) alignment */
@@ -67,31 +174,56 @@
 
 #define SIZE_PTR(p)  ((size_t*)(((char*)(p)) - SIZE_T_SIZE))
 
-#define WSIZE 4 // word + footer/header size
+#ifdef MM_WIDE
+typedef unsigned long word_t; // header, footer and free list link
+#else
+typedef unsigned int word_t;
+#endif
+#define WSIZE ((int)sizeof(word_t)) // word + footer/header size
 #define DSIZE 8 // double word size
-#define INFORSIZE 16
+#define INFORSIZE (4 * WSIZE) // smallest block: header, pred, succ, footer
+#define SLAB_MAXSIZE 64 // largest request served by the slab engine
+#define SLAB_CLASSES (SLAB_MAXSIZE / DSIZE) // one class per object size 8, 16, ..., SLAB_MAXSIZE
+#define RUN_SIZE 4096 // size and alignment of a slab run
+#define RUN_WORDS 8 // 64 bit words of run_t.map, enough for RUN_SIZE / DSIZE slots
 #define CHUNKSIZE (1<<8) // extend heap by this size
+#define HUGE_THRESHOLD (1<<16) // requests from this size get their own mapping
+#define HUGE_HDR 16 // bytes before a huge payload, a magic word and its mapping length
+#define TRIM_THRESHOLD (1<<22) // free trims the last free block from this size at first
+#define TRIM_MAX (1<<25) // largest that trim_threshold grows to
+#define TRIM_PAD (1<<16) // bytes that automatic trimming keeps at the end of heap
+#ifdef TLSF
+#define SL_LOG2 4
+#define SL_COUNT (1 << SL_LOG2) // second level lists per first level
+#define FL_SHIFT (SL_LOG2 + 3) // sizes below 1 << FL_SHIFT are first level 0
+#define FL_COUNT 25 // first levels, for sizes below 1 << (FL_COUNT + FL_SHIFT - 1)
+#define MAXLIST (FL_COUNT * SL_COUNT)
+#else
 #define MAXLIST 20
+#endif
+_Static_assert(MAXLIST <= MM_STATS_LISTS, "mm_stats_t and mm_frag_t keep MM_STATS_LISTS lists");
 #define MINSIZE 24
 
 #define MAX(x, y) (x > y ? x : y)
 //pack size and allocated bit into a word
 #define PACK(size, alloc) ((size) | (alloc))
 
-#define GET(p) ((p) ? *(unsigned int *)(p) : 0)
-#define PUT(p, val) ((p) ? *(unsigned int *)(p) = (val) : 0)
+#define GET(p) ((p) ? *(word_t *)(p) : 0)
+#define PUT(p, val) ((p) ? *(word_t *)(p) = (val) : 0)
 
 //if bp == 0 then do nothing
-#define PUT_P(p, val) ((p) ? (*(unsigned int *)(p) = val ? ((unsigned int)((char *)(val) - heap_listp)) : 0) : 0)
-#define GET_P(p) ((p)? (GET(p) ? (GET(p) + heap_listp) : 0) : 0)
+#define PUT_P(p, val) ((p) ? (*(word_t *)(p) = val ? ((word_t)((char *)(val) - H->heap_listp)) : 0) : 0)
+#define GET_P(p) ((p)? (GET(p) ? (GET(p) + H->heap_listp) : 0) : 0)
 
 #define GET_SIZE(p) (GET(p) & ~0x7) //size of block
 #define GET_ALLOC(p) (GET(p) & 0x1) //whether alloc
 #define GET_PREV_ALLOC(p) (GET(p) & 0x2)
+#define ZERO 0x4 // free block reads zero from CLEAN(bp) to its footer
+#define GET_ZERO(p) (GET(p) & ZERO)
 
 
 #define HDRP(bp) ((char *)bp - WSIZE)
-#define FTRP(bp) ((char *)bp + GET_SIZE(HDRP(bp)) - DSIZE)
+#define FTRP(bp) ((char *)bp + GET_SIZE(HDRP(bp)) - 2 * WSIZE)
 
 //if bp == 0 then do nothing
 #define PRED(bp) ((bp) ? (char *)(bp) : 0)
@@ -100,19 +232,180 @@
 #define NEXT_BLKP(bp) ((char *)(bp) + GET_SIZE(HDRP(bp)))
 #define PREV_BLKP(bp) ((char *)(bp) - GET_SIZE((HDRP(bp) - WSIZE)))
 
+#define CLEAN(bp) (*(word_t *)((char *)(bp) + 2 * WSIZE)) // of a ZERO block, after pred and succ
+
 //if bp == 0 then do nothing
 #define NEXT_LISTP(bp) ((bp) ? GET_P(SUCC(bp)) : 0)
 #define PREV_LISTP(bp) ((bp) ? GET_P(PRED(bp)) : 0)
 
-static char *heap_listp,*epilogue, *free_head[MAXLIST];
+#define SLAB_CLASS(size) (((size) - 1) / DSIZE) // class of a request, or of run_t.osize
+#define RUN_OF(p) ((run_t *)((unsigned long)(p) & ~(unsigned long)(RUN_SIZE - 1)))
+#define RUN_OBJS(run) ((char *)(run) + sizeof(run_t))
+#define SLAB_PAGE(p) (((char *)(p) - (char *)mem_heap_lo()) / RUN_SIZE)
+#define IS_SLAB(p) (slab_on && ((slab_map[SLAB_PAGE(p) / 32] >> (SLAB_PAGE(p) % 32)) & 1))
+
+#define HUGE_LEN(p) (*(size_t *)((char *)(p) - DSIZE)) // mapping length of huge payload p
+#define HUGE_MAGIC(p) (*(unsigned long *)((char *)(p) - HUGE_HDR)) // magic word of huge payload p
+#define HUGE_KEY(p) (0x6d6d2d687567650aUL ^ (unsigned long)(p)) // what it holds while p is huge
+#define IS_HUGE(p) (((char *)(p) < (char *)mem_heap_lo() || (char *)(p) > (char *)mem_heap_hi()) && \
+        ((unsigned long)(p) & (mem_pagesize() - 1)) == HUGE_HDR && HUGE_MAGIC(p) == HUGE_KEY(p))
+
+#define TC_MAXSIZE 128 // largest block size kept in the thread cache
+#define TC_CLASSES (TC_MAXSIZE / DSIZE - 1) // one list per block size 16, 24, ..., TC_MAXSIZE
+#define TC_LISTS (TC_CLASSES + SLAB_CLASSES) // slab objects of class i use list TC_CLASSES + i
+#define TC_MAX 16 // most blocks in one thread cache list
+#define TC_BATCH 8 // blocks moved between heap and thread cache at a time
+#define TC_CLASS(size) ((size) / DSIZE - 2)
 
+//link of thread cache list, stored in the payload of cached block
+#define TC_NEXT(bp) (*(char **)(bp))
+
+#ifdef MM_STATS
+#ifdef MM_THREADS
+#define STAT_ADD(field, n) __atomic_fetch_add(&H->stats.field, (n), __ATOMIC_RELAXED)
+#else
+#define STAT_ADD(field, n) (H->stats.field += (n))
+#endif
+#define FIT_HIT(bp) fit_hit(bp)
+#else
+#define STAT_ADD(field, n)
+#define FIT_HIT(bp) (bp)
+#endif
+
+#ifdef MM_THREADS
+#define LOCK() pthread_mutex_lock(&H->lock)
+#define UNLOCK() pthread_mutex_unlock(&H->lock)
+#else
+#define LOCK() ((void)0)
+#define UNLOCK() ((void)0)
+#endif
+
+typedef struct run {
+    struct run *next, *prev; // runs of the same class with a free slot
+    unsigned short osize; // object size
+    unsigned short nobj; // number of slots
+    unsigned short nfree; // number of free slots
+    unsigned short cls; // SLAB_CLASS(osize)
+    unsigned long long map[RUN_WORDS]; // bit set iff slot free
+} run_t;
+
+struct mm_heap {
+    mem_heap_t *mem; // the memlib heap it lives in
+    char *heap_listp, *epilogue, *free_head[MAXLIST];
+#ifdef TLSF
+    unsigned int fl_map; // bit fl set iff sl_map[fl] != 0
+    unsigned int sl_map[FL_COUNT]; // bit sl set iff free_head[fl * SL_COUNT + sl] != 0
+#else
+    unsigned int free_map; // bit i set iff free_head[i] != 0
+#endif
+    size_t trim_threshold; // free trims the last free block from this size
+    int trimmed; // free has trimmed the heap since it last grew
+    size_t place_dirty; // leading bytes of the block place() last allocated that may not be zero
+#ifdef MM_STATS
+    mm_stats_t stats; // reset by heap_init, read by mm_get_stats and mm_heap_get_stats
+#endif
+#ifdef MM_THREADS
+    pthread_mutex_t lock;
+#endif
+};
+
+#ifdef MM_THREADS
+static mm_heap_t default_heap = { .lock = PTHREAD_MUTEX_INITIALIZER }; // the heap of malloc and friends
+#else
+static mm_heap_t default_heap;
+#endif
+#ifdef MM_THREADS
+static __thread mm_heap_t *H = &default_heap; // heap being worked on, set by ENTER
+#else
+static mm_heap_t *H = &default_heap; // one thread, so no need for a load through TLS
+#endif
+#define ENTER(heap) (H = (heap), LOCK())
+#define LEAVE() (UNLOCK(), H = &default_heap)
+
+#ifdef TLSF
+#define MAP_SET(i) (H->sl_map[(i) / SL_COUNT] |= 1u << ((i) % SL_COUNT), H->fl_map |= 1u << ((i) / SL_COUNT))
+#define MAP_CLEAR(i) ((H->sl_map[(i) / SL_COUNT] &= ~(1u << ((i) % SL_COUNT))) ? 0 : (H->fl_map &= ~(1u << ((i) / SL_COUNT))))
+#define MAP_TEST(i) ((H->sl_map[(i) / SL_COUNT] >> ((i) % SL_COUNT)) & 1)
+#else
+#define MAP_SET(i) (H->free_map |= 1u << (i))
+#define MAP_CLEAR(i) (H->free_map &= ~(1u << (i)))
+#define MAP_TEST(i) ((H->free_map >> (i)) & 1)
+#endif
+static unsigned int heap_epoch; // bumped by mm_init, invalidates every thread cache
+
+static int slab_enabled = 0; // set by mm_set_slab, read by mm_init
+static size_t huge_threshold = HUGE_THRESHOLD; // set by mm_set_huge, 0 if off
+static int slab_on; // slab engine used for the current heap
+static run_t *slab_partial[SLAB_CLASSES];
+static unsigned int *slab_map; // bit set iff heap page starts a run, mapped when first used
+static size_t slab_words; // slab_map words that may have a bit set
+
+
+#ifdef MM_PRELOAD
+static int heap_ready; // set once heap_boot has made the heap
+static int heap_boot(void);
+#define BOOT() (__builtin_expect(__atomic_load_n(&heap_ready, __ATOMIC_ACQUIRE), 1) ? 0 : heap_boot())
+#else
+#define BOOT() 0
+#endif
+
+#ifdef MM_STATS
+// count a call to malloc etc., after the first one has made the heap whose mm_init clears the counters
+#define STAT_CALL(field) ((void)BOOT(), STAT_ADD(field, 1))
+#else
+#define STAT_CALL(field)
+#endif
+
+#ifdef MM_THREADS
+static __thread struct {
+    unsigned int epoch; // heap_epoch when the lists below were filled
+    unsigned int count[TC_LISTS];
+    char *head[TC_LISTS];
+} tcache;
+
+static pthread_key_t tc_key; // its destructor empties the cache of an exiting thread
+static pthread_once_t tc_key_once = PTHREAD_ONCE_INIT;
+static void tc_exit(void *unused);
+static void tc_key_create(void){ pthread_key_create(&tc_key, tc_exit); }
+#endif
+
+#ifdef TLSF
+/*
+    use size to determine which free_list it should be in
+    fl is the position of the highest bit of size, sl is the SL_LOG2 bits below it
+*/
+static inline int get_head(size_t size){
+    if(size < (1 << FL_SHIFT))return size / DSIZE;
+    int msb = 8 * sizeof(unsigned long) - 1 - __builtin_clzl(size);
+    int fl = msb - FL_SHIFT + 1;
+    if(fl >= FL_COUNT)return MAXLIST-1;
+    return fl * SL_COUNT + (int)(size >> (msb - SL_LOG2)) - SL_COUNT;
+}
+#else
 /*
     use size to determine which free_list it should be in
+    size <= (MINSIZE << i) iff (size - 1) / MINSIZE < (1 << i),
+    so i is the bit length of (size - 1) / MINSIZE, found by count-leading-zeros
 */
 static inline int get_head(size_t size){
-    int i = 0;
-    for( ; i < MAXLIST; i++)if(size <= (size_t)(MINSIZE << i))return i;
-    return MAXLIST-1;
+    size_t q = (size - 1) / MINSIZE;
+    if(q == 0)return 0;
+    int i = 8 * sizeof(unsigned long) - __builtin_clzl(q);
+    return i < MAXLIST ? i : MAXLIST-1;
+}
+#endif
+
+/*
+    the first free list find_fit looks on for asize. With TLSF asize is rounded
+    up to the first size of the next list, unless it already is one,
+    so that every block on that list and above is large enough
+*/
+static inline int fit_head(size_t asize){
+#ifdef TLSF
+    if(asize >= (1 << FL_SHIFT))
+        asize += (1UL << (8 * sizeof(unsigned long) - 1 - __builtin_clzl(asize) - SL_LOG2)) - 1;
+#endif
+    return get_head(asize);
 }
 /*
     remove ptr from the free_list match it size
@@ -121,7 +414,13 @@ static inline void remove_bp(void *bp){
     int head = get_head(GET_SIZE(HDRP(bp)));
     PUT_P(SUCC(PREV_LISTP(bp)),NEXT_LISTP(bp));
     PUT_P(PRED(NEXT_LISTP(bp)),PREV_LISTP(bp));
-    if(bp == free_head[head])free_head[head] = (char *)NEXT_LISTP(free_head[head]);
+    if(bp == H->free_head[head]){
+        H->free_head[head] = (char *)NEXT_LISTP(H->free_head[head]);
+        if(H->free_head[head] == 0)MAP_CLEAR(head);
+    }
+#ifdef MM_STATS
+    H->stats.free_bytes[head] -= GET_SIZE(HDRP(bp));
+#endif
 }
 
 /*  
@@ -130,10 +429,28 @@ static inline void remove_bp(void *bp){
 */
 static inline void put_bp(void *bp){
     int head = get_head(GET_SIZE(HDRP(bp)));
-    PUT_P(SUCC(bp),free_head[head]);
+    PUT_P(SUCC(bp),H->free_head[head]);
     PUT_P(PRED(bp),0);
-    PUT_P(PRED(free_head[head]),bp);
-    free_head[head] = bp;
+    PUT_P(PRED(H->free_head[head]),bp);
+    H->free_head[head] = bp;
+    MAP_SET(head);
+#ifdef MM_STATS
+    H->stats.free_bytes[head] += GET_SIZE(HDRP(bp));
+    if(H->stats.free_bytes[head] > H->stats.peak_free_bytes[head])
+        H->stats.peak_free_bytes[head] = H->stats.free_bytes[head];
+#endif
+}
+
+/*
+    mark free block bp as reading zero from bp + clean up to its footer,
+    unless that leaves no zero byte
+*/
+static inline void mark_zero(char *bp, size_t clean){
+    if(clean < 3 * WSIZE)clean = 3 * WSIZE;
+    if(clean + 2 * WSIZE >= GET_SIZE(HDRP(bp)))return;
+    PUT(HDRP(bp), GET(HDRP(bp)) | ZERO);
+    PUT(FTRP(bp), GET(FTRP(bp)) | ZERO);
+    CLEAN(bp) = clean;
 }
 
 /*
@@ -148,31 +465,43 @@ static inline void *coalesce(void *bp){
 
     if(prev_alloc && next_alloc){
         // do nothing
+        STAT_ADD(coalesce[0], 1);
     }
     else if(prev_alloc && !next_alloc){//next 为空
-        remove_bp(NEXT_BLKP(bp));
-        size += GET_SIZE(HDRP(NEXT_BLKP(bp)));
+        STAT_ADD(coalesce[1], 1);
+        char *next = NEXT_BLKP(bp);
+        size_t clean = GET_ZERO(HDRP(next)) ? size + CLEAN(next) : 0;
+        remove_bp(next);
+        size += GET_SIZE(HDRP(next));
         PUT(HDRP(bp), PACK(size, 2));
         PUT(FTRP(bp), PACK(size, 2));
+        if(clean)mark_zero(bp, clean);
     }
     else if(!prev_alloc && next_alloc){//prev 为空
-        remove_bp(PREV_BLKP(bp));
-        size += GET_SIZE(HDRP(PREV_BLKP(bp)));
+        STAT_ADD(coalesce[2], 1);
+        char *prev = PREV_BLKP(bp);
+        size_t clean = GET_ZERO(HDRP(bp)) ? GET_SIZE(HDRP(prev)) + CLEAN(bp) : 0;
+        remove_bp(prev);
+        size += GET_SIZE(HDRP(prev));
 
-        bp = PREV_BLKP(bp);
+        bp = prev;
         PUT(HDRP(bp), PACK(size, 2));
         PUT(FTRP(bp), PACK(size, 2));  
-        
+        if(clean)mark_zero(bp, clean);
     }
     else{
-        remove_bp(NEXT_BLKP(bp));
-        remove_bp(PREV_BLKP(bp));
+        STAT_ADD(coalesce[3], 1);
+        char *prev = PREV_BLKP(bp), *next = NEXT_BLKP(bp);
+        size_t clean = GET_ZERO(HDRP(next)) ? GET_SIZE(HDRP(prev)) + size + CLEAN(next) : 0;
+        remove_bp(next);
+        remove_bp(prev);
 
-        size += GET_SIZE(HDRP(PREV_BLKP(bp))) + GET_SIZE(FTRP(NEXT_BLKP(bp)));//next prev 均为空
-        bp = PREV_BLKP(bp);
+        size += GET_SIZE(HDRP(prev)) + GET_SIZE(FTRP(next));//next prev 均为空
+        bp = prev;
 
         PUT(HDRP(bp), PACK(size, 2));
         PUT(FTRP(bp), PACK(size, 2));
+        if(clean)mark_zero(bp, clean);
     }
     put_bp(bp);
     return bp;
@@ -187,42 +516,237 @@ static inline void *coalesce(void *bp){
 static inline void *extend_heap(size_t words){
     char *bp;
     size_t size;
+    char *clean = mem_heap_clean(H->mem);
 
     // allocate an even number of words to maintain alignment
     size = (words % 2) ? (words + 1) * WSIZE : words * WSIZE;
-    if((long)(bp = mem_sbrk(size)) == -1)return NULL;
+    if((long)(bp = mem_heap_sbrk(H->mem, size)) == -1)return NULL;
+    if(H->trimmed){
+        H->trimmed = 0;
+        if(H->trim_threshold < TRIM_MAX)H->trim_threshold *= 2;
+    }
+    STAT_ADD(extend_calls, 1);
+    STAT_ADD(extend_bytes, size);
     // initialize free block header/footer and the epilogue header
 
     PUT(HDRP(bp), PACK(size, GET_PREV_ALLOC(HDRP(bp))));
     PUT(FTRP(bp), PACK(size, GET_PREV_ALLOC(HDRP(bp))));
 
     PUT(HDRP(NEXT_BLKP(bp)),PACK(0, 1));
-    epilogue = NEXT_BLKP(bp);
+    H->epilogue = NEXT_BLKP(bp);
+    if(clean < H->epilogue)mark_zero(bp, clean > bp ? (size_t)(clean - bp + WSIZE - 1) & ~(size_t)(WSIZE - 1) : 0);
 
     return coalesce(bp);
 }
 
 /*
-    mm_init - Called when a new trace starts.
+    heap_init - make an empty heap H in H->mem
     prologue block, with header, footer, pred, succ, alloc = 1, with total size 6 words
     epilogue block, only with header, size 0, alloca = 1
     initialize free_head[i] into empty part
 */
-int mm_init(void)
+static int heap_init(void)
 {
-    heap_listp = mem_sbrk(6 * WSIZE);
-    PUT(heap_listp, 0);
-    PUT(heap_listp + (1 * WSIZE), PACK(INFORSIZE, 3)); // prologue header
+    char *p;
+    if((p = mem_heap_sbrk(H->mem, 6 * WSIZE)) == (void *)-1)return -1;
+    H->heap_listp = p;
+    PUT(H->heap_listp, 0);
+    PUT(H->heap_listp + (1 * WSIZE), PACK(INFORSIZE, 3)); // prologue header
     
-    heap_listp += 2 * WSIZE;
-    PUT_P(heap_listp, 0); // prologue pred
-    PUT_P(heap_listp + WSIZE, 0); // prologue succ
-    PUT(heap_listp + (2 * WSIZE), PACK(INFORSIZE, 3)); // prologue footer
-    PUT(heap_listp + (3 * WSIZE), PACK(0,3));// epilogue header
-
-    epilogue = heap_listp + (3 * WSIZE);
-    for(int i = 0; i < MAXLIST; i++)free_head[i] = 0;
+    H->heap_listp += 2 * WSIZE;
+    PUT_P(H->heap_listp, 0); // prologue pred
+    PUT_P(H->heap_listp + WSIZE, 0); // prologue succ
+    PUT(H->heap_listp + (2 * WSIZE), PACK(INFORSIZE, 3)); // prologue footer
+    PUT(H->heap_listp + (3 * WSIZE), PACK(0,3));// epilogue header
+
+    H->epilogue = H->heap_listp + INFORSIZE;
+    for(int i = 0; i < MAXLIST; i++)H->free_head[i] = 0;
+#ifdef TLSF
+    H->fl_map = 0;
+    for(int i = 0; i < FL_COUNT; i++)H->sl_map[i] = 0;
+#else
+    H->free_map = 0;
+#endif
+    H->trim_threshold = TRIM_THRESHOLD;
+    H->trimmed = 0;
+#ifdef MM_STATS
+    memset(&H->stats, 0, sizeof(H->stats));
+    H->stats.nlists = MAXLIST;
+#endif
+    return 0;
+}
+
+/*
+    mm_init - Called when a new trace starts.
+    make the default heap empty and reset the thread caches, slab engine and counters
+*/
+int mm_init(void)
+{
+    default_heap.mem = mem_default();
+    if(heap_init() < 0)return -1;
+    heap_epoch++;
+    slab_on = slab_enabled;
+    // SLAB_PAGE counts pages from the heap start, RUN_OF from address 0
+    assert(!slab_on || ((unsigned long)mem_heap_lo() & (RUN_SIZE - 1)) == 0);
+    for(int i = 0; i < SLAB_CLASSES; i++)slab_partial[i] = 0;
+    if(slab_map)memset(slab_map, 0, slab_words * sizeof(slab_map[0]));
+    slab_words = 0;
+    // a bit for each page of MAX_HEAP, pages of it are only made as runs need them
+    if(slab_on && slab_map == NULL){
+        void *map = mmap(NULL, MAX_HEAP / RUN_SIZE / 8, PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if(map == MAP_FAILED)slab_on = 0;
+        else slab_map = map;
+    }
+    return 0;
+}
+
+#ifdef MM_PRELOAD
+/*
+    fork must not copy the heap while another thread is changing it
+*/
+static void atfork_prepare(void){ LOCK(); }
+static void atfork_release(void){ UNLOCK(); }
+
+/*
+    heap_boot - make the heap on the first malloc of a process using libmm.so
+    with transparent huge pages if MM_THP is set in the environment,
+    and the slab engine if MM_SLAB is
+    return -1 if the heap can't be reserved
+*/
+static int heap_boot(void){
+    int ret = 0, booted = 0;
+    LOCK();
+    if(!heap_ready){
+        mem_set_thp(getenv("MM_THP") != NULL);
+        slab_enabled = getenv("MM_SLAB") != NULL;
+        mem_init();
+        if((ret = mm_init()) == 0){
+            __atomic_store_n(&heap_ready, 1, __ATOMIC_RELEASE);
+            booted = 1;
+        }
+    }
+    UNLOCK();
+    // may malloc, so only after the heap is ready, and only by the thread
+    // that made it: handlers registered twice would take the lock twice
+    if(booted)pthread_atfork(atfork_prepare, atfork_release, atfork_release);
+    return ret;
+}
+#endif
+
+/*
+    trim the free block before the epilogue down to pad bytes, caller holds H->lock
+    the rest of it is given back with a negative mem_sbrk
+    return 1 if any memory was released
+*/
+static int heap_trim(size_t pad){
+    if(GET_PREV_ALLOC(HDRP(H->epilogue)))return 0;
+    char *bp = PREV_BLKP(H->epilogue);
+    size_t size = GET_SIZE(HDRP(bp));
+    size_t prev_alloc = GET_PREV_ALLOC(HDRP(bp));
+    size_t keep = ALIGN(pad);
+    if(keep != 0 && keep < INFORSIZE)keep = INFORSIZE;
+    if(keep + mem_pagesize() > size)return 0;
+
+    remove_bp(bp);
+    if(keep){
+        PUT(HDRP(bp), PACK(keep, prev_alloc));
+        PUT(FTRP(bp), PACK(keep, prev_alloc));
+        put_bp(bp);
+        H->epilogue = bp + keep;
+        PUT(HDRP(H->epilogue), PACK(0, 1));
+    }
+    else{
+        H->epilogue = bp;
+        PUT(HDRP(H->epilogue), PACK(0, prev_alloc | 1));
+    }
+    mem_heap_sbrk(H->mem, -(intptr_t)(size - keep));
+    STAT_ADD(trim_calls, 1);
+    STAT_ADD(trim_bytes, size - keep);
+    return 1;
+}
+
+/*
+    mm_trim - give back the free memory at the end of heap, but pad bytes
+    return 1 if any memory was released
+*/
+int mm_trim(size_t pad){
+    int ret;
+    if(BOOT() < 0)return 0;
+    LOCK();
+    ret = heap_trim(pad);
+    UNLOCK();
+    return ret;
+}
+
+#ifdef MM_PRELOAD
+int malloc_trim(size_t pad){
+    return mm_trim(pad);
+}
+#endif
+
+/*
+    mm_set_slab - turn the slab engine on or off for the heaps made by later mm_init
+*/
+void mm_set_slab(int enable){
+    slab_enabled = enable;
+}
+
+/*
+    mm_set_huge - map requests of threshold bytes or more on their own, 0 turns it off
+*/
+void mm_set_huge(size_t threshold){
+    huge_threshold = threshold;
+}
+
+/*
+    mm_get_frag - walk the free lists of the malloc heap into frag,
+    blocks held by the thread cache or the slab engine count as allocated
+*/
+void mm_get_frag(mm_frag_t *frag){
+    memset(frag, 0, sizeof(*frag));
+    frag->nlists = MAXLIST;
+    LOCK();
+    for(int i = 0; H->heap_listp && i < MAXLIST; i++){
+        for(char *bp = H->free_head[i]; bp != 0; bp = (char *)NEXT_LISTP(bp)){
+            size_t size = GET_SIZE(HDRP(bp));
+            frag->free_blocks[i]++;
+            frag->free_bytes += size;
+            if(size > frag->largest_free)frag->largest_free = size;
+        }
+    }
+    UNLOCK();
+}
+
+/*
+    mm_size_class - the free list that mm_malloc starts its search on for a request
+    of size bytes, as find_fit rounds it, for tools that bin request sizes
+*/
+int mm_size_class(size_t size){
+    return fit_head(ALIGN(MAX(size + WSIZE, INFORSIZE)));
+}
+
+/*
+    mm_size_classes - the number of free lists, MAXLIST of this build
+*/
+int mm_size_classes(void){
+    return MAXLIST;
+}
+
+/*
+    mm_get_stats - copy the counters since the last mm_init into stats
+    return -1 if they are not kept in this build
+*/
+int mm_get_stats(mm_stats_t *stats){
+#ifdef MM_STATS
+    LOCK();
+    *stats = H->stats;
+    UNLOCK();
     return 0;
+#else
+    memset(stats, 0, sizeof(*stats));
+    return -1;
+#endif
 }
 
 /*
@@ -235,64 +759,101 @@ int mm_init(void)
 static inline void place(void *bp, size_t asize){
     size_t size = GET_SIZE(HDRP(bp));
     size_t remain_size = size - asize;
+    size_t clean = GET_ZERO(HDRP(bp)) ? CLEAN(bp) : size;
+    // a known-zero block gets a zero footer, so only its first clean bytes are dirty
     if(remain_size <= INFORSIZE){ 
         remove_bp(bp);
         PUT(HDRP(bp), PACK(size, 3));
-        PUT(FTRP(bp), PACK(size, 3));
+        PUT(FTRP(bp), clean < size ? 0 : PACK(size, 3));
         size_t next_size = GET_SIZE(HDRP(NEXT_BLKP(bp)));
         PUT(HDRP(NEXT_BLKP(bp)),PACK(next_size, 3));
     }
     else{
+        STAT_ADD(splits, 1);
         remove_bp(bp);
         PUT(HDRP(bp), PACK(asize, 3));
-        PUT(FTRP(bp), PACK(asize, 3));
+        PUT(FTRP(bp), clean < asize ? 0 : PACK(asize, 3));
         void *remain_bp = NEXT_BLKP(bp);
         PUT(HDRP(remain_bp), PACK(remain_size, 2));
         PUT(FTRP(remain_bp), PACK(remain_size, 2));
+        if(clean < size)mark_zero(remain_bp, clean > asize ? clean - asize : 0);
         put_bp(remain_bp);
     }
+    H->place_dirty = clean;
 }
 
+#ifdef MM_STATS
+/*
+    count a block found by find_fit on the free list it comes from
+*/
+static inline void *fit_hit(void *bp){
+    if(bp)H->stats.list_hits[get_head(GET_SIZE(HDRP(bp)))]++;
+    return bp;
+}
+#endif
+
+#ifdef TLSF
+/*
+    find the block can put asize
+    round asize up to the first size of the next list, unless it already is one,
+    then any block on its list or a larger one is large enough:
+    take the first non-empty list at or above it in sl_map[fl],
+    else the first non-empty first level above fl in fl_map.
+    Only sizes beyond the last first level need to walk the last list.
+*/
+static inline void *find_fit(size_t asize){
+    int head = fit_head(asize);
+    if(head == MAXLIST-1){
+        for(char *bp = H->free_head[head]; bp != 0; bp = (char *)NEXT_LISTP(bp)){
+            STAT_ADD(fit_visits, 1);
+            if(GET_SIZE(HDRP(bp)) >= asize)return FIT_HIT(bp);
+        }
+        return NULL;
+    }
+    int fl = head / SL_COUNT;
+    unsigned int map = H->sl_map[fl] & (~0u << (head % SL_COUNT));
+    if(map == 0){
+        unsigned int fmap = H->fl_map & (~0u << fl << 1);
+        if(fmap == 0)return NULL;
+        fl = __builtin_ctz(fmap);
+        map = H->sl_map[fl];
+    }
+    return FIT_HIT(H->free_head[fl * SL_COUNT + __builtin_ctz(map)]);
+}
+#else
 /*
     find the block can put asize
     first find free list with (48 << (i-1)) <= size <= (48 << i)
-    if there no match block, then find i+1 free list
-    if i+1 free list is empty, then keep finding i+2
+    if there no match block, then take the first non-empty free list larger than i,
+    which is the lowest set bit of free_map above i
     if all larger free list is empty, it means there is no match free block, return null
 */
 static inline void *find_fit(size_t asize){
-    int head = get_head(asize);
-    char* bp = free_head[head];
+    int head = fit_head(asize);
+    char* bp = H->free_head[head];
     size_t size;
     while(bp != 0){
+        STAT_ADD(fit_visits, 1);
         size = GET_SIZE(HDRP(bp));
-        if(size >= asize)return bp;
+        if(size >= asize)return FIT_HIT(bp);
         bp = (char *)NEXT_LISTP(bp);
     }
-    for(int i = head + 1; i < MAXLIST; i++){
-        bp = free_head[i];
-        if (bp != 0)return bp;
-    }
-    return NULL;
+    unsigned int map = H->free_map & (~0u << head << 1);
+    if(map == 0)return NULL;
+    return FIT_HIT(H->free_head[__builtin_ctz(map)]);
 }
+#endif
 
 /*
-    malloc - Allocate a block by incrementing the brk pointer.
-    Add header and footer to size, and make the final size larger than the total size of footer,header,pred_ptr,succ_ptr
-    Always allocate a block whose size is a multiple of the alignment.
+    heap_malloc - Allocate a block of asize from the shared heap, caller holds H->lock.
     If we successfully find the fit free block, then place asize in bp.
     Otherwise, choose to extend heap, then we get the free block we want
  */
-void *malloc(size_t size)
+static void *heap_malloc(size_t asize)
 {
-    size_t asize;
     size_t extendsize;
     char *bp;
-    //ignore spurious request
-    if(size == 0)return NULL;
-    
-    //adjust block size
-    asize = ALIGN(MAX(size + WSIZE ,INFORSIZE));
+
     if((bp = find_fit(asize)) != NULL)place(bp, asize);
     else {
         //No fit found. Get more memory and place the block
@@ -304,13 +865,12 @@ void *malloc(size_t size)
 }
 
 /*
-    Firstly check if ptr is in heap boundry.
+    heap_free - Return a block to the shared heap, caller holds H->lock.
     Update the ptr's station to free
     Try to coalesce it with free block adjacent to it
+    If that makes a large free block at the end of heap, trim it
  */
-void free(void *ptr){
-    if (ptr < mem_heap_lo() || ptr > mem_heap_hi()) return;
-
+static void heap_free(void *ptr){
     size_t size = GET_SIZE(HDRP(ptr));
     size_t prev_alloc = GET_PREV_ALLOC(HDRP(ptr));
 
@@ -320,59 +880,751 @@ void free(void *ptr){
     size_t next_size = GET_SIZE(HDRP(NEXT_BLKP(ptr)));
     size_t next_alloc = GET_ALLOC(HDRP(NEXT_BLKP(ptr)));
     PUT(HDRP(NEXT_BLKP(ptr)),PACK(next_size,next_alloc));
-    coalesce(ptr);
+    ptr = coalesce(ptr);
+    if(NEXT_BLKP(ptr) == H->epilogue && GET_SIZE(HDRP(ptr)) >= H->trim_threshold)H->trimmed |= heap_trim(TRIM_PAD);
+}
+
+/*
+    carve a RUN_SIZE aligned run out of free block bp
+    the part before the run stays free if there is any, so the run never
+    starts less than INFORSIZE after bp, and place() splits off the part after it
+    return NULL if bp is too small
+*/
+static run_t *slab_carve(char *bp){
+    size_t size = GET_SIZE(HDRP(bp));
+    size_t prev_alloc = GET_PREV_ALLOC(HDRP(bp));
+    char *run = (char *)RUN_OF(bp + RUN_SIZE - 1);
+    if(run != bp && run - bp < INFORSIZE)run += RUN_SIZE;
+    size_t front = run - bp;
+    if(front + RUN_SIZE > size)return NULL;
+
+    if(front){
+        remove_bp(bp);
+        PUT(HDRP(bp), PACK(front, prev_alloc));
+        PUT(FTRP(bp), PACK(front, prev_alloc));
+        put_bp(bp);
+        PUT(HDRP(run), PACK(size - front, 0));
+        PUT(FTRP(run), PACK(size - front, 0));
+        put_bp(run);
+    }
+    place(run, RUN_SIZE);
+    if(front){
+        // place() assumes the block before is allocated
+        PUT(HDRP(run), GET(HDRP(run)) & ~0x2);
+        PUT(FTRP(run), GET(FTRP(run)) & ~0x2);
+    }
+    return (run_t *)run;
 }
 
 /*
-    realloc - Change the size of the block by mallocing a new block,
-    copying its data, and freeing the old block. 
+    get a new run for objects of class cls
+    firstly try a free block large enough to hold an aligned run wherever it starts,
+    otherwise extend heap so that the tail free block holds one
+*/
+static run_t *slab_new_run(int cls){
+    run_t *run = NULL;
+    char *bp;
+
+    if((bp = find_fit(2 * RUN_SIZE)) != NULL)run = slab_carve(bp);
+    if(run == NULL){
+        size_t front = (char *)RUN_OF(H->epilogue + RUN_SIZE - 1) - H->epilogue;
+        if(front != 0 && front < INFORSIZE)front += RUN_SIZE;
+        if((bp = extend_heap((front + RUN_SIZE) / WSIZE)) == NULL)return NULL;
+        if((run = slab_carve(bp)) == NULL)return NULL;
+    }
+
+    run->osize = (cls + 1) * DSIZE;
+    run->cls = cls;
+    run->nobj = (RUN_SIZE - sizeof(run_t) - DSIZE) / run->osize;
+    run->nfree = run->nobj;
+    memset(run->map, 0, sizeof(run->map));
+    for(int i = 0; i < run->nobj / 64; i++)run->map[i] = ~0ULL;
+    if(run->nobj % 64)run->map[run->nobj / 64] = (1ULL << (run->nobj % 64)) - 1;
+
+    slab_map[SLAB_PAGE(run) / 32] |= 1u << (SLAB_PAGE(run) % 32);
+    if((size_t)SLAB_PAGE(run) / 32 >= slab_words)slab_words = SLAB_PAGE(run) / 32 + 1;
+    run->prev = 0;
+    run->next = slab_partial[cls];
+    if(run->next)run->next->prev = run;
+    slab_partial[cls] = run;
+    return run;
+}
+
+/*
+    take a free slot from the first partial run of class cls
+    a run with no free slot left is removed from slab_partial
+*/
+static void *slab_malloc(int cls){
+    run_t *run = slab_partial[cls];
+    if(run == NULL && (run = slab_new_run(cls)) == NULL)return NULL;
+
+    int w = 0;
+    while(run->map[w] == 0)w++;
+    int b = __builtin_ctzll(run->map[w]);
+    run->map[w] &= run->map[w] - 1;
+    if(--run->nfree == 0){
+        slab_partial[cls] = run->next;
+        if(run->next)run->next->prev = 0;
+        run->next = 0;
+    }
+    return RUN_OBJS(run) + (w * 64 + b) * run->osize;
+}
+
+/*
+    give slot ptr back to its run
+    a full run gets back on slab_partial, an empty run goes back to the heap
+    if its class has another partial run
+*/
+static void slab_free(void *ptr){
+    run_t *run = RUN_OF(ptr);
+    int i = ((char *)ptr - RUN_OBJS(run)) / run->osize;
+    run->map[i / 64] |= 1ULL << (i % 64);
+
+    if(run->nfree++ == 0){
+        run->prev = 0;
+        run->next = slab_partial[run->cls];
+        if(run->next)run->next->prev = run;
+        slab_partial[run->cls] = run;
+    }
+    else if(run->nfree == run->nobj && (run->prev || run->next)){
+        if(run->prev)run->prev->next = run->next;
+        else slab_partial[run->cls] = run->next;
+        if(run->next)run->next->prev = run->prev;
+        slab_map[SLAB_PAGE(run) / 32] &= ~(1u << (SLAB_PAGE(run) % 32));
+        heap_free(run);
+    }
+}
+
+/*
+    usable bytes of allocated ptr, slab objects have no header to read it from
+*/
+static inline size_t payload_size(void *ptr){
+    if(IS_HUGE(ptr))return HUGE_LEN(ptr) - HUGE_HDR;
+    return IS_SLAB(ptr) ? RUN_OF(ptr)->osize : GET_SIZE(HDRP(ptr)) - WSIZE;
+}
+
+/*
+    map a region of whole pages for a huge payload of size bytes
+*/
+static void *huge_malloc(size_t size){
+    size_t len = (size + HUGE_HDR + mem_pagesize() - 1) & ~(mem_pagesize() - 1);
+    char *p = mem_map(len);
+    if(p == NULL)return NULL;
+    STAT_ADD(huge_maps, 1);
+    HUGE_MAGIC(p + HUGE_HDR) = HUGE_KEY(p + HUGE_HDR);
+    HUGE_LEN(p + HUGE_HDR) = len;
+    return p + HUGE_HDR;
+}
+
+static void huge_free(void *ptr){
+    HUGE_MAGIC(ptr) = 0;
+    mem_unmap((char *)ptr - HUGE_HDR, HUGE_LEN(ptr));
+}
+
+/*
+    resize the mapping of huge ptr to hold size bytes, mem_remap moves its pages if it must
+    return NULL and leave ptr as it was if that fails
+*/
+static void *huge_realloc(void *ptr, size_t size){
+    size_t len = (size + HUGE_HDR + mem_pagesize() - 1) & ~(mem_pagesize() - 1);
+    if(len == HUGE_LEN(ptr))return ptr;
+    char *p = mem_remap((char *)ptr - HUGE_HDR, HUGE_LEN(ptr), len);
+    if(p == NULL)return NULL;
+    STAT_ADD(huge_remaps, 1);
+    HUGE_MAGIC(p + HUGE_HDR) = HUGE_KEY(p + HUGE_HDR);
+    HUGE_LEN(p + HUGE_HDR) = len;
+    return p + HUGE_HDR;
+}
+
+#ifdef MM_THREADS
+/*
+    allocate for thread cache list c when it is empty,
+    list c < TC_CLASSES holds heap blocks of size c and the others hold slab objects
+*/
+static inline void *tc_source_malloc(int c, size_t asize){
+    return c < TC_CLASSES ? heap_malloc(asize) : slab_malloc(c - TC_CLASSES);
+}
+
+static inline void tc_source_free(int c, void *bp){
+    if(c < TC_CLASSES)heap_free(bp);
+    else slab_free(bp);
+}
+
+/*
+    drop this thread's cached blocks if mm_init has reset the heap since they were cached,
+    on the first use by a thread also ask for tc_exit when it exits
+*/
+static inline void tc_check_epoch(void){
+    if(tcache.epoch != heap_epoch){
+        memset(&tcache, 0, sizeof(tcache));
+        tcache.epoch = heap_epoch;
+        pthread_once(&tc_key_once, tc_key_create);
+        pthread_setspecific(tc_key, &tcache);
+    }
+}
+
+/*
+    tc_exit - give every block in the cache of an exiting thread back to where it came from,
+    a later malloc of the thread in another destructor starts a new cache
+*/
+static void tc_exit(void *unused){
+    (void)unused;
+    if(tcache.epoch != heap_epoch)return;
+    LOCK();
+    for(int c = 0; c < TC_LISTS; c++){
+        while(tcache.head[c] != 0){
+            char *bp = tcache.head[c];
+            tcache.head[c] = TC_NEXT(bp);
+            tc_source_free(c, bp);
+        }
+        tcache.count[c] = 0;
+    }
+    UNLOCK();
+    tcache.epoch = heap_epoch - 1;
+}
+
+/*
+    take TC_BATCH blocks for thread cache list c, return one of them
+    and keep the others in the thread cache list match their real size
+*/
+static void *tc_refill(int c, size_t asize){
+    char *bp, *ret;
+    LOCK();
+    ret = tc_source_malloc(c, asize);
+    for(int i = 1; ret != NULL && i < TC_BATCH; i++){
+        if((bp = tc_source_malloc(c, asize)) == NULL)break;
+        int bc = c < TC_CLASSES ? (int)TC_CLASS(GET_SIZE(HDRP(bp))) : c;
+        if((c < TC_CLASSES && bc >= TC_CLASSES) || tcache.count[bc] >= TC_MAX){
+            tc_source_free(c, bp);
+            break;
+        }
+        TC_NEXT(bp) = tcache.head[bc];
+        tcache.head[bc] = bp;
+        tcache.count[bc]++;
+    }
+    UNLOCK();
+    return ret;
+}
+
+/*
+    give TC_BATCH blocks of thread cache list c and ptr back to where they came from
+*/
+static void tc_flush(int c, void *ptr){
+    LOCK();
+    for(int i = 0; i < TC_BATCH && tcache.head[c] != 0; i++){
+        char *bp = tcache.head[c];
+        tcache.head[c] = TC_NEXT(bp);
+        tcache.count[c]--;
+        tc_source_free(c, bp);
+    }
+    tc_source_free(c, ptr);
+    UNLOCK();
+}
+#endif
+
+/*
+    alloc - the body of malloc. Allocate a block by incrementing the brk pointer.
+    Add header and footer to size, and make the final size larger than the total size of footer,header,pred_ptr,succ_ptr
+    Always allocate a block whose size is a multiple of the alignment.
+    Requests up to SLAB_MAXSIZE are slab objects, other small blocks are heap blocks,
+    in MM_THREADS builds both come from the thread cache when it has one,
+    otherwise take the heap lock and search the free lists or the slab runs.
+    *dirty is set to how many bytes from the start of the block may not be zero, for calloc.
+ */
+static inline void *alloc(size_t size, size_t *dirty)
+{
+    size_t asize;
+    char *bp;
+    //ignore spurious request
+    if(size == 0)return NULL;
+    if(size > MAX_HEAP || BOOT() < 0){
+        errno = ENOMEM;
+        return NULL;
+    }
+    
+    //adjust block size
+    asize = ALIGN(MAX(size + WSIZE ,INFORSIZE));
+#ifdef MM_THREADS
+    if(asize <= TC_MAXSIZE){
+        int c = slab_on && size <= SLAB_MAXSIZE ? TC_CLASSES + SLAB_CLASS(size) : TC_CLASS(asize);
+        tc_check_epoch();
+        if((bp = tcache.head[c]) != 0){
+            tcache.head[c] = TC_NEXT(bp);
+            tcache.count[c]--;
+            STAT_ADD(tcache_hits, 1);
+        }
+        else bp = tc_refill(c, asize);
+        *dirty = size;
+    }
+    else
+#endif
+    if(slab_on && size <= SLAB_MAXSIZE){
+        LOCK();
+        bp = slab_malloc(SLAB_CLASS(size));
+        UNLOCK();
+        *dirty = size;
+    }
+    else if(huge_threshold && size >= huge_threshold){
+        bp = huge_malloc(size);
+        *dirty = 0; // fresh pages from mem_map
+    }
+    else{
+        LOCK();
+        bp = heap_malloc(asize);
+        *dirty = H->place_dirty;
+        UNLOCK();
+    }
+#ifdef MM_STATS
+    if(bp){
+        STAT_ADD(bytes_requested, size);
+        STAT_ADD(bytes_allocated, IS_HUGE(bp) ? HUGE_LEN(bp) : IS_SLAB(bp) ? RUN_OF(bp)->osize : GET_SIZE(HDRP(bp)));
+    }
+#endif
+    return bp;
+}
+
+void *malloc(size_t size)
+{
+    size_t dirty;
+    STAT_CALL(malloc_calls);
+    return alloc(size, &dirty);
+}
+
+/*
+    release - the body of free.
+    Firstly check if ptr is in heap boundry, huge blocks outside it are unmapped.
+    Keep slab object or small block in the thread cache if its list is not full,
+    otherwise give it back to its run or the heap
+ */
+static inline void release(void *ptr){
+    if (ptr == NULL) return;
+    if (IS_HUGE(ptr)){
+        huge_free(ptr);
+        return;
+    }
+    if (ptr < mem_heap_lo() || ptr > mem_heap_hi()) return;
+
+    size_t size = IS_SLAB(ptr) ? 0 : GET_SIZE(HDRP(ptr));
+#ifdef MM_THREADS
+    if(size <= TC_MAXSIZE){
+        int c = size ? (int)TC_CLASS(size) : TC_CLASSES + RUN_OF(ptr)->cls;
+        tc_check_epoch();
+        if(tcache.count[c] < TC_MAX){
+            TC_NEXT(ptr) = tcache.head[c];
+            tcache.head[c] = ptr;
+            tcache.count[c]++;
+            return;
+        }
+        tc_flush(c, ptr);
+        return;
+    }
+#endif
+    LOCK();
+    if(size == 0)slab_free(ptr);
+    else heap_free(ptr);
+    UNLOCK();
+}
+
+void free(void *ptr){
+    STAT_CALL(free_calls);
+    release(ptr);
+}
+
+/*
+    shrink allocated block bp to asize, caller holds H->lock
+    as in place(), the remain part is split off only if it can be a free block,
+    it is coalesced with the block after it and put back into free list
+*/
+static void shrink_block(void *bp, size_t asize){
+    size_t size = GET_SIZE(HDRP(bp));
+    size_t remain_size = size - asize;
+    if(remain_size <= INFORSIZE)return;
+
+    // no footer, the end of an allocated block is payload
+    PUT(HDRP(bp), PACK(asize, GET_PREV_ALLOC(HDRP(bp)) | 1));
+    void *remain_bp = NEXT_BLKP(bp);
+    PUT(HDRP(remain_bp), PACK(remain_size, 2));
+    PUT(FTRP(remain_bp), PACK(remain_size, 2));
+    PUT(HDRP(NEXT_BLKP(remain_bp)), GET(HDRP(NEXT_BLKP(remain_bp))) & ~0x2);
+    coalesce(remain_bp);
+}
+
+/*
+    try to resize allocated block bp to asize without moving it, caller holds H->lock
+    If asize is smaller, split off the tail.
+    If bp is the last block, or only a free block lies between bp and epilogue,
+    extend heap so that free block is large enough, when that adds at most
+    a quarter of bp or no free block fits asize; else bp moves to the fit.
+    If the next block is free and large enough, take it and split off what is not needed.
+    return 0 if bp has to move
+*/
+static int resize_block(void *bp, size_t asize){
+    size_t size = GET_SIZE(HDRP(bp));
+    char *next = NEXT_BLKP(bp);
+    size_t next_size = GET_ALLOC(HDRP(next)) ? 0 : GET_SIZE(HDRP(next));
+
+    if(asize <= size){
+        shrink_block(bp, asize);
+        return 1;
+    }
+    if(next == H->epilogue || (next_size && NEXT_BLKP(next) == H->epilogue)){
+        size_t grow = asize - size - next_size;
+        // growing the heap for a block that fits elsewhere leaves that hole unused
+        if(size + next_size < asize && (4 * grow <= size || find_fit(asize) == NULL)){
+            if(extend_heap(MAX(grow, INFORSIZE) / WSIZE) == NULL)return 0;
+            next_size = GET_SIZE(HDRP(next));
+        }
+    }
+    if(next_size == 0 || size + next_size < asize)return 0;
+
+    remove_bp(next);
+    size += next_size;
+    PUT(HDRP(bp), PACK(size, GET_PREV_ALLOC(HDRP(bp)) | 1));
+    PUT(HDRP(NEXT_BLKP(bp)), GET(HDRP(NEXT_BLKP(bp))) | 0x2);
+    shrink_block(bp, asize);
+    return 1;
+}
+
+/*
+    realloc - Change the size of the block in place if we can:
+    a slab object keeps its slot while size fits in it,
+    a huge block stays huge and is remapped while size is above huge_threshold,
+    a heap block is shrunk or grown by resize_block() unless size is huge.
+    Otherwise malloc a new block, copy its data, and free the old block.
  */
 void *realloc(void *oldptr, size_t size)
 {
-    size_t oldsize;
+    size_t oldsize, dirty;
     void *newptr;
+    int done;
 
+    STAT_CALL(realloc_calls);
     /* If size == 0 then this is just free, and we return NULL. */
     if(size == 0) {
-        free(oldptr);
+        release(oldptr);
         return 0;
     }
 
     /* If oldptr is NULL, then this is just malloc. */
-    if(oldptr == NULL)return malloc(size);
-    newptr = malloc(size);
+    if(oldptr == NULL)return alloc(size, &dirty);
+
+    if(IS_HUGE(oldptr)){
+        if(huge_threshold && size >= huge_threshold)return huge_realloc(oldptr, size);
+    }
+    else if(IS_SLAB(oldptr)){
+        if(size <= RUN_OF(oldptr)->osize)return oldptr;
+    }
+    else if(!huge_threshold || size < huge_threshold){
+        LOCK();
+        done = resize_block(oldptr, ALIGN(MAX(size + WSIZE ,INFORSIZE)));
+        UNLOCK();
+        if(done)return oldptr;
+    }
+    newptr = alloc(size, &dirty);
 
     /* If realloc() fails the original block is left untouched  */
     if(!newptr)return 0;
 
     /* Copy the old data. */
-    oldsize = *SIZE_PTR(oldptr);
+    oldsize = payload_size(oldptr);
     if(size < oldsize) oldsize = size;
     memcpy(newptr, oldptr, oldsize);
 
     /* Free the old block. */
-    free(oldptr);
+    release(oldptr);
     return newptr;
 }
 
 /*
     calloc - Allocate the block and set it to zero.
+    Only the bytes alloc() reports as maybe dirty are cleared,
+    fail with ENOMEM if nmemb * size overflows.
  */
 void *calloc (size_t nmemb, size_t size)
 {
-    size_t bytes = nmemb * size;
+    size_t bytes, dirty;
     void *newptr;
-    newptr = malloc(bytes);
-    memset(newptr, 0, bytes);
+    STAT_CALL(calloc_calls);
+    if(__builtin_mul_overflow(nmemb, size, &bytes)){
+        errno = ENOMEM;
+        return NULL;
+    }
+    if((newptr = alloc(bytes, &dirty)) == NULL)return NULL;
+    if(dirty > bytes)dirty = bytes;
+    STAT_ADD(calloc_bytes, bytes);
+    STAT_ADD(calloc_cleared, dirty);
+    memset(newptr, 0, dirty);
     return newptr;
 }
 
+/*
+    align_alloc - the body of memalign. Allocate size bytes at a multiple of align, a power of two.
+    Take a heap block with room for an aligned bp at least INFORSIZE past its start,
+    give the part before bp back as a free block, and split off the tail as realloc does.
+ */
+static void *align_alloc(size_t align, size_t size)
+{
+    size_t asize, front, dirty;
+    char *bp, *abp = NULL;
+
+    if(align <= ALIGNMENT)return alloc(size, &dirty);
+    if(size == 0)return NULL;
+    if(size > MAX_HEAP || align > MAX_HEAP || BOOT() < 0){
+        errno = ENOMEM;
+        return NULL;
+    }
+    while(align & (align - 1))align += align & -align; // round up to a power of two
+
+    asize = ALIGN(MAX(size + WSIZE ,INFORSIZE));
+    LOCK();
+    if((bp = heap_malloc(asize + align + INFORSIZE)) != NULL){
+        abp = (char *)(((unsigned long)bp + align - 1) & ~(align - 1));
+        while(abp != bp && abp - bp < INFORSIZE)abp += align;
+        if((front = abp - bp) != 0){
+            size_t size = GET_SIZE(HDRP(bp));
+            size_t prev_alloc = GET_PREV_ALLOC(HDRP(bp));
+            PUT(HDRP(abp), PACK(size - front, 1));
+            PUT(HDRP(bp), PACK(front, prev_alloc));
+            PUT(FTRP(bp), PACK(front, prev_alloc));
+            coalesce(bp);
+        }
+        shrink_block(abp, asize);
+    }
+    UNLOCK();
+    return abp;
+}
+
+void *memalign(size_t align, size_t size)
+{
+    STAT_CALL(memalign_calls);
+    return align_alloc(align, size);
+}
+
+/*
+    posix_memalign - memalign that reports EINVAL for an align that is not
+    a power of two multiple of sizeof(void *), and ENOMEM, instead of setting errno
+ */
+int posix_memalign(void **memptr, size_t align, size_t size)
+{
+    void *ptr;
+    STAT_CALL(memalign_calls);
+    if(align < sizeof(void *) || (align & (align - 1)))return EINVAL;
+    if((ptr = align_alloc(align, size)) == NULL && size != 0)return ENOMEM;
+    *memptr = ptr;
+    return 0;
+}
+
+/*
+    aligned_alloc - C11 memalign, align must be a power of two
+ */
+void *aligned_alloc(size_t align, size_t size)
+{
+    STAT_CALL(memalign_calls);
+    if(align == 0 || (align & (align - 1))){
+        errno = EINVAL;
+        return NULL;
+    }
+    return align_alloc(align, size);
+}
+
+/*
+    malloc_usable_size - bytes of ptr the caller may use, at least the size it asked for
+ */
+size_t malloc_usable_size(void *ptr)
+{
+    return ptr ? payload_size(ptr) : 0;
+}
+
+/*
+    reallocarray - realloc to nmemb * size bytes, fail with ENOMEM if that overflows
+ */
+void *reallocarray(void *ptr, size_t nmemb, size_t size)
+{
+    size_t bytes;
+    if(__builtin_mul_overflow(nmemb, size, &bytes)){
+        errno = ENOMEM;
+        return NULL;
+    }
+    return realloc(ptr, bytes);
+}
+
+/*
+    mm_heap_create - make a heap of its own that can grow to max bytes.
+    Its mm_heap_t sits at the start of its memlib heap, so mm_heap_destroy
+    is one munmap however much is allocated in it.
+    return NULL if the address space can't be reserved
+ */
+mm_heap_t *mm_heap_create(size_t max)
+{
+    mem_heap_t *mem;
+    mm_heap_t *heap;
+    int ret;
+
+    if((mem = mem_heap_create(max)) == NULL)return NULL;
+    if((heap = mem_heap_sbrk(mem, ALIGN(sizeof(mm_heap_t)))) == (void *)-1){
+        mem_heap_destroy(mem);
+        errno = ENOMEM;
+        return NULL;
+    }
+    heap->mem = mem;
+#ifdef MM_THREADS
+    pthread_mutex_init(&heap->lock, NULL);
+#endif
+    ENTER(heap);
+    ret = heap_init();
+    LEAVE();
+    if(ret < 0){
+        mem_heap_destroy(mem);
+        errno = ENOMEM;
+        return NULL;
+    }
+    return heap;
+}
+
+/*
+    mm_heap_destroy - free every block of heap and the heap itself
+ */
+void mm_heap_destroy(mm_heap_t *heap)
+{
+#ifdef MM_THREADS
+    pthread_mutex_destroy(&heap->lock);
+#endif
+    mem_heap_destroy(heap->mem);
+}
+
+/*
+    the bodies of mm_heap_malloc and mm_heap_free, caller holds H->lock of the heap
+ */
+static void *own_alloc(size_t size){
+    char *bp = heap_malloc(ALIGN(MAX(size + WSIZE ,INFORSIZE)));
+#ifdef MM_STATS
+    if(bp){
+        STAT_ADD(bytes_requested, size);
+        STAT_ADD(bytes_allocated, GET_SIZE(HDRP(bp)));
+    }
+#endif
+    if(bp == NULL)errno = ENOMEM;
+    return bp;
+}
+
+static void own_release(void *ptr){
+    if((char *)ptr > H->heap_listp && (char *)ptr < H->epilogue)heap_free(ptr);
+}
+
+/*
+    mm_heap_malloc - malloc from heap, straight from its free lists:
+    there is no thread cache, slab run or huge block in a heap of its own
+ */
+void *mm_heap_malloc(mm_heap_t *heap, size_t size)
+{
+    char *bp;
+    if(size == 0)return NULL;
+    if(size > MAX_HEAP){
+        errno = ENOMEM;
+        return NULL;
+    }
+    ENTER(heap);
+    STAT_ADD(malloc_calls, 1);
+    bp = own_alloc(size);
+    LEAVE();
+    return bp;
+}
+
+/*
+    mm_heap_free - free ptr from mm_heap_malloc(heap, ...), ignore it if it is not in heap
+ */
+void mm_heap_free(mm_heap_t *heap, void *ptr)
+{
+    if(ptr == NULL)return;
+    ENTER(heap);
+    STAT_ADD(free_calls, 1);
+    own_release(ptr);
+    LEAVE();
+}
+
+/*
+    mm_heap_realloc - realloc within heap, in place when resize_block() can
+ */
+void *mm_heap_realloc(mm_heap_t *heap, void *oldptr, size_t size)
+{
+    size_t oldsize;
+    void *newptr = NULL;
+
+    ENTER(heap);
+    STAT_ADD(realloc_calls, 1);
+    if(size == 0){
+        if(oldptr != NULL)own_release(oldptr);
+    }
+    else if(size > MAX_HEAP)errno = ENOMEM;
+    else if(oldptr == NULL)newptr = own_alloc(size);
+    else if(resize_block(oldptr, ALIGN(MAX(size + WSIZE ,INFORSIZE))))newptr = oldptr;
+    else if((newptr = own_alloc(size)) != NULL){
+        oldsize = GET_SIZE(HDRP(oldptr)) - WSIZE;
+        if(size < oldsize) oldsize = size;
+        memcpy(newptr, oldptr, oldsize);
+        own_release(oldptr);
+    }
+    LEAVE();
+    return newptr;
+}
+
+/*
+    mm_heap_calloc - calloc within heap, clearing only what place() reports as dirty
+ */
+void *mm_heap_calloc(mm_heap_t *heap, size_t nmemb, size_t size)
+{
+    size_t bytes, dirty;
+    char *bp;
+
+    if(__builtin_mul_overflow(nmemb, size, &bytes) || bytes > MAX_HEAP){
+        errno = ENOMEM;
+        return NULL;
+    }
+    if(bytes == 0)return NULL;
+    ENTER(heap);
+    STAT_ADD(calloc_calls, 1);
+    bp = heap_malloc(ALIGN(MAX(bytes + WSIZE ,INFORSIZE)));
+    dirty = H->place_dirty;
+#ifdef MM_STATS
+    if(bp){
+        STAT_ADD(bytes_requested, bytes);
+        STAT_ADD(bytes_allocated, GET_SIZE(HDRP(bp)));
+        STAT_ADD(calloc_bytes, bytes);
+        STAT_ADD(calloc_cleared, dirty < bytes ? dirty : bytes);
+    }
+#endif
+    LEAVE();
+    if(bp == NULL){
+        errno = ENOMEM;
+        return NULL;
+    }
+    memset(bp, 0, dirty < bytes ? dirty : bytes);
+    return bp;
+}
+
+/*
+    mm_heap_get_stats - copy the counters of heap since mm_heap_create into stats
+    return -1 if they are not kept in this build
+*/
+int mm_heap_get_stats(mm_heap_t *heap, mm_stats_t *stats){
+#ifdef MM_STATS
+    ENTER(heap);
+    *stats = H->stats;
+    LEAVE();
+    return 0;
+#else
+    (void)heap;
+    memset(stats, 0, sizeof(*stats));
+    return -1;
+#endif
+}
+
 /*
     const I use: 
     ALIGNMENT 8
-    WSIZE 4
+    WSIZE 4 (8 with MM_WIDE)
     DSIZE 8
-    INFORSIZE 16
+    INFORSIZE 16 (32 with MM_WIDE)
     CHUNKSIZE (1<<8)
     MAXLIST 20
     MINSIZE 48
@@ -383,9 +1635,9 @@ void *calloc (size_t nmemb, size_t size)
 void mm_checkheap(int verbose){
     // check prologue and epilogue
     if(verbose == 0){
-        printf("prologue: header: %lu footer: %lu alloc: %d size: %u \n",
-        (size_t)HDRP(heap_listp),(size_t)FTRP(heap_listp),GET_ALLOC(HDRP(heap_listp)), GET_SIZE(HDRP(heap_listp)));
-        printf("epilogue: header: %lu alloc: %d size: %u\n",(size_t)HDRP(epilogue),GET_ALLOC(HDRP(epilogue)),GET_SIZE(HDRP(epilogue)));
+        printf("prologue: header: %lu footer: %lu alloc: %d size: %lu \n",
+        (size_t)HDRP(H->heap_listp),(size_t)FTRP(H->heap_listp),(int)GET_ALLOC(HDRP(H->heap_listp)), (size_t)GET_SIZE(HDRP(H->heap_listp)));
+        printf("epilogue: header: %lu alloc: %d size: %lu\n",(size_t)HDRP(H->epilogue),(int)GET_ALLOC(HDRP(H->epilogue)),(size_t)GET_SIZE(HDRP(H->epilogue)));
 
     }
     // traverse free list
@@ -393,7 +1645,7 @@ void mm_checkheap(int verbose){
         for(int i = 0; i < MAXLIST; i++)
         {
         printf("free list: %d \n",i);
-        char* bp = free_head[i];
+        char* bp = H->free_head[i];
         int cnt = 0;
         size_t size;
         while(bp != 0){
@@ -408,7 +1660,7 @@ void mm_checkheap(int verbose){
     }
     // traverse whole heap list
     else if(verbose == 2){ 
-        char* bp = heap_listp;
+        char* bp = H->heap_listp;
         int alloc;
         size_t size = GET_SIZE(HDRP(bp));
         printf("heap list: %ld size: %lu\n",(size_t)bp,size);
@@ -429,7 +1681,7 @@ void mm_checkheap(int verbose){
     // check whether all ptr in heap list are in heap boundry
     else if(verbose == 3){ 
         //puts("check boundry");
-        char* bp = heap_listp;
+        char* bp = H->heap_listp;
         size_t size = GET_SIZE(HDRP(bp));
         while(size > 0){
             if((size_t)bp < (size_t)mem_heap_lo() || (size_t)bp > (size_t)mem_heap_hi()){
@@ -443,7 +1695,7 @@ void mm_checkheap(int verbose){
     // check all ptr in heap list's header and footer's size and allcate station
     else if(verbose == 4){ 
         //puts("check header and footer");
-        char* bp = heap_listp;
+        char* bp = H->heap_listp;
         size_t size_h = GET_SIZE(HDRP(bp));
         size_t size_f = GET_SIZE(FTRP(bp));
         size_t alloc_h = GET_ALLOC(HDRP(bp));
@@ -467,8 +1719,8 @@ void mm_checkheap(int verbose){
     // check if there is two adjacent free block
     else if(verbose == 5){
         //puts("check free block");
-        char* prev = heap_listp;
-        char* now = NEXT_BLKP(heap_listp);
+        char* prev = H->heap_listp;
+        char* now = NEXT_BLKP(H->heap_listp);
         size_t size = GET_SIZE(HDRP(now));
         while(size > 0){
             if(!GET_ALLOC(HDRP(prev)) && !GET_ALLOC(HDRP(now))){
@@ -483,8 +1735,8 @@ void mm_checkheap(int verbose){
     // check all ptr in free list's pred and succ
     else if(verbose == 6){ 
         for(int i = 0; i < MAXLIST; i++){
-            if(free_head[i] == 0)return;
-            char *prev = free_head[i];
+            if(H->free_head[i] == 0)return;
+            char *prev = H->free_head[i];
             char *now = (char *)NEXT_LISTP(prev);
             while(now != 0){
                 char * succ = NEXT_LISTP(prev);
@@ -501,7 +1753,7 @@ void mm_checkheap(int verbose){
     // check if all ptr in free list are in boundry
     else if(verbose == 7){
         for(int i = 0; i < MAXLIST; i++){
-            char *bp = free_head[i];
+            char *bp = H->free_head[i];
             while(bp != 0){
                 if((size_t)bp < (size_t)mem_heap_lo() || (size_t)bp > (size_t)mem_heap_hi()){
                     puts("illegal ptr");
@@ -514,10 +1766,10 @@ void mm_checkheap(int verbose){
     // check if ptr are in the correct free list match its size
     else if(verbose == 8){
         for(int i = 0; i < MAXLIST; i++){
-            char *bp = free_head[i];
+            char *bp = H->free_head[i];
             while(bp != 0){
                 size_t size = GET_SIZE(HDRP(bp));
-                if(size > (size_t)(MINSIZE<< i) || (i > 0 && size <= (size_t)(MINSIZE << (i-1)))){
+                if(get_head(size) != i){
                     puts("size unmatch");
                     exit(0);
                 }
@@ -529,7 +1781,7 @@ void mm_checkheap(int verbose){
     else if(verbose == 9){
         int free_cnt = 0;
         for (size_t id = 0; id < MAXLIST; id++){
-            char *bp = free_head[id];
+            char *bp = H->free_head[id];
             while(bp){
                 free_cnt++;
                 if (GET_ALLOC(HDRP(bp))){
@@ -539,7 +1791,7 @@ void mm_checkheap(int verbose){
                 bp = (char *)NEXT_LISTP(bp);
             }
         }
-        char *bp = heap_listp;
+        char *bp = H->heap_listp;
         while(GET_SIZE(HDRP(bp))){
             if (!GET_ALLOC(HDRP(bp))) free_cnt--;
             bp = NEXT_BLKP(bp);
@@ -549,4 +1801,21 @@ void mm_checkheap(int verbose){
             exit(0);
         }
     }
+    // check if free_map bit i is set exactly when free list i is not empty
+    else if(verbose == 10){
+        for(int i = 0; i < MAXLIST; i++){
+            if(MAP_TEST(i) != (H->free_head[i] != 0)){
+                printf("free_map bit %d unmatch free list\n", i);
+                exit(0);
+            }
+        }
+#ifdef TLSF
+        for(int i = 0; i < FL_COUNT; i++){
+            if(((H->fl_map >> i) & 1) != (H->sl_map[i] != 0)){
+                printf("fl_map bit %d unmatch sl_map\n", i);
+                exit(0);
+            }
+        }
+#endif
+    }
 }
@@ -7,6 +7,11 @@ extern void *mm_malloc (size_t size);
 extern void mm_free (void *ptr);
 extern void *mm_realloc(void *ptr, size_t size);
 extern void *mm_calloc (size_t nmemb, size_t size);
+extern void *mm_memalign(size_t align, size_t size);
+extern int mm_posix_memalign(void **memptr, size_t align, size_t size);
+extern void *mm_aligned_alloc(size_t align, size_t size);
+extern size_t mm_malloc_usable_size(void *ptr);
+extern void *mm_reallocarray(void *ptr, size_t nmemb, size_t size);
 
 #else
 
@@ -15,11 +20,89 @@ extern void *malloc (size_t size);
 extern void free (void *ptr);
 extern void *realloc(void *ptr, size_t size);
 extern void *calloc (size_t nmemb, size_t size);
+extern void *memalign(size_t align, size_t size);
+extern int posix_memalign(void **memptr, size_t align, size_t size);
+extern void *aligned_alloc(size_t align, size_t size);
+extern size_t malloc_usable_size(void *ptr);
+extern void *reallocarray(void *ptr, size_t nmemb, size_t size);
 
 #endif
 
 extern int mm_init(void);
 
+/* Heaps of their own, apart from the one malloc uses. mm_heap_destroy
+   frees everything in a heap at once, so its blocks need no free */
+typedef struct mm_heap mm_heap_t;
+extern mm_heap_t *mm_heap_create(size_t max);
+extern void mm_heap_destroy(mm_heap_t *heap);
+extern void *mm_heap_malloc(mm_heap_t *heap, size_t size);
+extern void mm_heap_free(mm_heap_t *heap, void *ptr);
+extern void *mm_heap_realloc(mm_heap_t *heap, void *ptr, size_t size);
+extern void *mm_heap_calloc(mm_heap_t *heap, size_t nmemb, size_t size);
+
+/* Give back the free memory at the end of the heap but pad bytes,
+   return 1 if any was released */
+extern int mm_trim(size_t pad);
+#ifndef DRIVER
+extern int malloc_trim(size_t pad);
+#endif
+
+/* Give requests of threshold bytes or more a mapping of their own, 0 turns it off */
+extern void mm_set_huge(size_t threshold);
+
+/* The free list, of mm_size_classes(), that malloc starts to search for
+   a request of size bytes, whether or not the slab or a mapping takes it.
+   With TLSF that is the list above the one a block of the size goes on,
+   unless the size is the first of its list */
+extern int mm_size_class(size_t size);
+extern int mm_size_classes(void);
+
+/* Turn the slab engine for small requests on or off, from the next mm_init */
+extern void mm_set_slab(int enable);
+
 /* This is largely for debugging.  You can do what you want with the
    verbose flag; we don't care. */
 extern void mm_checkheap(int verbose);
+
+/*
+ * Allocator counters, kept only when mm.c is built with -DMM_STATS and
+ * reset by mm_init. Without it mm_get_stats returns -1 and costs nothing.
+ * Each call is counted once, under the function the program called:
+ * posix_memalign and aligned_alloc count as memalign.
+ * A heap from mm_heap_create counts its own calls, in mm_heap_get_stats.
+ */
+#define MM_STATS_LISTS 400 /* enough for the free lists of any build */
+
+typedef struct {
+    unsigned long malloc_calls, free_calls, realloc_calls, calloc_calls, memalign_calls;
+    unsigned long bytes_requested; /* sum of malloc sizes */
+    unsigned long bytes_allocated; /* sum of block and slot sizes handed out */
+    unsigned long tcache_hits;     /* mallocs served by the thread cache (MM_THREADS) */
+    unsigned long fit_visits;      /* free list nodes visited in find_fit */
+    unsigned long splits;          /* blocks split by place */
+    unsigned long coalesce[4];     /* coalesce with none, next, prev, both free */
+    unsigned long extend_calls, extend_bytes;
+    unsigned long trim_calls, trim_bytes;
+    unsigned long huge_maps, huge_remaps; /* mem_map and mem_remap of huge blocks */
+    unsigned long calloc_bytes, calloc_cleared; /* bytes calloc returned, and had to clear */
+    int nlists;                    /* free lists in use below */
+    unsigned long list_hits[MM_STATS_LISTS];  /* find_fit results per free list */
+    unsigned long free_bytes[MM_STATS_LISTS]; /* bytes on each free list now... */
+    unsigned long peak_free_bytes[MM_STATS_LISTS]; /* ... and at most */
+} mm_stats_t;
+
+extern int mm_get_stats(mm_stats_t *stats);
+extern int mm_heap_get_stats(mm_heap_t *heap, mm_stats_t *stats);
+
+/*
+ * The free blocks of the malloc heap now, found by walking its free
+ * lists. Blocks in the thread cache and free slab slots are not in them.
+ */
+typedef struct {
+    size_t free_bytes;             /* bytes in free blocks, headers included */
+    size_t largest_free;           /* the largest free block */
+    int nlists;                    /* free lists in use below */
+    unsigned long free_blocks[MM_STATS_LISTS]; /* free blocks on each list */
+} mm_frag_t;
+
+extern void mm_get_frag(mm_frag_t *frag);
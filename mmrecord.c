@@ -0,0 +1,410 @@
+/*
+ * mmrecord.c - record the allocation requests of a real program
+ *
+ * Built as librecord.so, run as LD_PRELOAD=./librecord.so cmd, it wraps
+ * the malloc, free, realloc, reallocarray, calloc, memalign,
+ * posix_memalign and aligned_alloc of libc. Each thread appends a rec_t
+ * per request to a ring of its own, with no lock: the thread only moves
+ * the ring's head and a flusher thread only its tail. The flusher
+ * writes each ring to its file <prefix>.<pid>.<ring>.raw, with <prefix>
+ * from MMRECORD (default "mmrecord"), and rec2rep turns the files into
+ * a .rep trace.
+ *
+ * A seq number from one counter puts the requests of all threads in
+ * order. It is taken before the block is given back to libc by free,
+ * and after libc has handed it out otherwise, so a block is freed
+ * before its address is seen again. A realloc is both: a REALLOC
+ * record goes before the call, for the old address it may free, and
+ * a MOVED record after it, with the address it returned. A ring whose
+ * thread has exited is drained and then reused by the next new thread.
+ *
+ * Nothing here may call malloc. The requests dlsym makes before the
+ * libc functions are known come from a static arena and are not
+ * recorded, nor are those of the flusher or a forked child.
+ */
+#define _GNU_SOURCE
+#include <dlfcn.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "mmrecord.h"
+
+#define RING_RECS   (1 << 16) /* records in a ring, a power of two */
+#define ARENA_SIZE  (1 << 16) /* bytes for the requests of dlsym */
+#define FLUSH_NSECS 1000000   /* flusher sleep when all rings are empty */
+
+enum { RING_LIVE, RING_DEAD, RING_FREE };
+
+typedef struct ring {
+	struct ring *next;    /* all rings, never removed */
+	rec_t *recs;
+	int state;            /* RING_LIVE, RING_DEAD once its thread exits, RING_FREE once drained */
+	int no;               /* number in the file name */
+	int fd;               /* its file, -1 until the flusher opens it */
+	uint64_t head __attribute__((aligned(64))); /* next record the thread writes */
+	uint64_t tail __attribute__((aligned(64))); /* next record the flusher writes */
+} ring_t;
+
+/* the libc functions */
+static struct {
+	void *(*malloc)(size_t);
+	void (*free)(void *);
+	void *(*realloc)(void *, size_t);
+	void *(*calloc)(size_t, size_t);
+	void *(*memalign)(size_t, size_t);
+	int (*posix_memalign)(void **, size_t, size_t);
+	void *(*aligned_alloc)(size_t, size_t);
+} real;
+
+static int resolving;          /* dlsym is looking up real */
+static int recording;          /* requests are recorded */
+static uint64_t next_seq;
+static ring_t *rings;
+static int nrings;
+static pthread_key_t ring_key; /* its destructor marks the ring of an exiting thread */
+static pthread_t flusher_thread;
+static int flusher_state;      /* 0 not started, 1 starting, 2 running */
+static int stopping;
+static char prefix[256];
+
+static __thread ring_t *my_ring;
+static __thread int busy;      /* set in the recorder's own calls, and for good at thread exit */
+
+static char arena[ARENA_SIZE] __attribute__((aligned(16)));
+static size_t arena_used;
+#define IN_ARENA(p) ((char *)(p) >= arena && (char *)(p) < arena + ARENA_SIZE)
+
+static void start_flusher(void);
+
+/*
+ * arena_alloc - hand out zeroed bytes of the arena while dlsym runs
+ */
+static void *arena_alloc(size_t size)
+{
+	size_t off = __atomic_fetch_add(&arena_used, (size + 15) & ~(size_t)15, __ATOMIC_RELAXED);
+	if (off + size > ARENA_SIZE)
+		return NULL;
+	return arena + off;
+}
+
+/*
+ * ring_detach - pthread key destructor, the thread's ring may be
+ *     drained and reused, and the thread records nothing from now on
+ */
+static void ring_detach(void *arg)
+{
+	ring_t *r = arg;
+	busy = 1;
+	my_ring = NULL;
+	__atomic_store_n(&r->state, RING_DEAD, __ATOMIC_RELEASE);
+}
+
+/*
+ * resolve - look up the libc functions, and start recording
+ */
+static void resolve(void)
+{
+	const char *p;
+
+	resolving = 1;
+	real.malloc = dlsym(RTLD_NEXT, "malloc");
+	real.free = dlsym(RTLD_NEXT, "free");
+	real.realloc = dlsym(RTLD_NEXT, "realloc");
+	real.calloc = dlsym(RTLD_NEXT, "calloc");
+	real.memalign = dlsym(RTLD_NEXT, "memalign");
+	real.posix_memalign = dlsym(RTLD_NEXT, "posix_memalign");
+	real.aligned_alloc = dlsym(RTLD_NEXT, "aligned_alloc");
+	resolving = 0;
+
+	p = getenv("MMRECORD");
+	snprintf(prefix, sizeof(prefix), "%s", p && *p ? p : "mmrecord");
+	if (pthread_key_create(&ring_key, ring_detach) == 0)
+		__atomic_store_n(&recording, 1, __ATOMIC_RELEASE);
+}
+
+#define RESOLVED() (__builtin_expect(real.malloc != NULL, 1) || (resolve(), 0))
+
+/*
+ * ring_attach - give the calling thread a ring, a drained one if there
+ *     is any, return NULL if there is no memory for a new one
+ */
+static ring_t *ring_attach(void)
+{
+	ring_t *r;
+	int state = RING_FREE;
+
+	busy = 1;
+	start_flusher();
+	for (r = __atomic_load_n(&rings, __ATOMIC_ACQUIRE); r; r = r->next)
+		if (__atomic_load_n(&r->state, __ATOMIC_RELAXED) == RING_FREE &&
+				__atomic_compare_exchange_n(&r->state, &state, RING_LIVE, 0,
+					__ATOMIC_ACQ_REL, __ATOMIC_RELAXED))
+			break;
+		else
+			state = RING_FREE;
+	if (r == NULL) {
+		r = mmap(NULL, sizeof(ring_t) + RING_RECS * sizeof(rec_t),
+				PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (r == MAP_FAILED) {
+			busy = 0;
+			return NULL;
+		}
+		r->recs = (rec_t *)(r + 1);
+		r->state = RING_LIVE;
+		r->fd = -1;
+		r->no = __atomic_fetch_add(&nrings, 1, __ATOMIC_RELAXED);
+		r->next = __atomic_load_n(&rings, __ATOMIC_RELAXED);
+		while (!__atomic_compare_exchange_n(&rings, &r->next, r, 0,
+					__ATOMIC_RELEASE, __ATOMIC_RELAXED))
+			;
+	}
+	pthread_setspecific(ring_key, r);
+	my_ring = r;
+	busy = 0;
+	return r;
+}
+
+/*
+ * record - append a request to the thread's ring, waiting for the
+ *     flusher if it is full
+ */
+static inline void record(uint32_t type, void *ptr, uint64_t arg, size_t size)
+{
+	ring_t *r = my_ring;
+	rec_t *e;
+	uint64_t h;
+
+	if (busy || !__atomic_load_n(&recording, __ATOMIC_ACQUIRE))
+		return;
+	if (r == NULL && (r = ring_attach()) == NULL)
+		return;
+	h = r->head;
+	while (h - __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE) == RING_RECS)
+		sched_yield();
+	e = &r->recs[h & (RING_RECS - 1)];
+	e->seq = __atomic_fetch_add(&next_seq, 1, __ATOMIC_RELAXED);
+	e->ptr = (uint64_t)ptr;
+	e->arg = arg;
+	e->size = size > UINT32_MAX ? UINT32_MAX : size;
+	e->type = type;
+	__atomic_store_n(&r->head, h + 1, __ATOMIC_RELEASE);
+}
+
+/*
+ * drain - write what ring r holds to its file, return the records written
+ */
+static size_t drain(ring_t *r)
+{
+	int state = __atomic_load_n(&r->state, __ATOMIC_ACQUIRE);
+	uint64_t head = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+	uint64_t tail = r->tail, n;
+	char path[sizeof(prefix) + 64];
+
+	if (head == tail) {
+		if (state == RING_DEAD)
+			__atomic_store_n(&r->state, RING_FREE, __ATOMIC_RELEASE);
+		return 0;
+	}
+	if (r->fd < 0) {
+		snprintf(path, sizeof(path), "%s.%d.%d.raw", prefix, (int)getpid(), r->no);
+		if ((r->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0)
+			r->fd = open("/dev/null", O_WRONLY);
+	}
+	while (tail != head) {
+		uint64_t i = tail & (RING_RECS - 1);
+		uint64_t n = head - tail < RING_RECS - i ? head - tail : RING_RECS - i;
+		char *buf = (char *)&r->recs[i];
+		size_t len = n * sizeof(rec_t);
+		while (len > 0) {
+			ssize_t w = write(r->fd, buf, len);
+			if (w < 0 && errno == EINTR)
+				continue;
+			if (w <= 0)
+				break; /* can't write it, drop it */
+			buf += w;
+			len -= w;
+		}
+		tail += n;
+	}
+	n = head - r->tail;
+	__atomic_store_n(&r->tail, head, __ATOMIC_RELEASE);
+	return n;
+}
+
+/*
+ * flusher - drain the rings until the process exits
+ */
+static void *flusher(void *arg)
+{
+	struct timespec nap = { 0, FLUSH_NSECS };
+	(void)arg;
+
+	busy = 1;
+	for (;;) {
+		int stop = __atomic_load_n(&stopping, __ATOMIC_ACQUIRE);
+		size_t moved = 0;
+		for (ring_t *r = __atomic_load_n(&rings, __ATOMIC_ACQUIRE); r; r = r->next)
+			moved += drain(r);
+		if (stop && moved == 0)
+			break;
+		if (moved == 0)
+			nanosleep(&nap, NULL);
+	}
+	return NULL;
+}
+
+/*
+ * fork_child - a forked child has no flusher, and its own pid
+ */
+static void fork_child(void)
+{
+	recording = 0;
+	flusher_state = 0;
+}
+
+/*
+ * start_flusher - start the flusher thread, once
+ */
+static void start_flusher(void)
+{
+	int state = 0;
+
+	if (__atomic_load_n(&flusher_state, __ATOMIC_ACQUIRE) != 0 ||
+			!__atomic_compare_exchange_n(&flusher_state, &state, 1, 0,
+				__ATOMIC_ACQ_REL, __ATOMIC_RELAXED))
+		return;
+	pthread_atfork(NULL, NULL, fork_child);
+	if (pthread_create(&flusher_thread, NULL, flusher, NULL) != 0) {
+		recording = 0;
+		return;
+	}
+	__atomic_store_n(&flusher_state, 2, __ATOMIC_RELEASE);
+}
+
+/*
+ * stop_recording - at exit, stop recording and write what is left
+ */
+__attribute__((destructor))
+static void stop_recording(void)
+{
+	__atomic_store_n(&recording, 0, __ATOMIC_RELEASE);
+	if (__atomic_load_n(&flusher_state, __ATOMIC_ACQUIRE) != 2)
+		return;
+	__atomic_store_n(&stopping, 1, __ATOMIC_RELEASE);
+	pthread_join(flusher_thread, NULL);
+	flusher_state = 0;
+	for (ring_t *r = rings; r; r = r->next)
+		if (r->fd >= 0)
+			close(r->fd);
+}
+
+/**********************
+ * The wrapped functions
+ **********************/
+
+void *malloc(size_t size)
+{
+	void *p;
+
+	if (resolving)
+		return arena_alloc(size);
+	RESOLVED();
+	if ((p = real.malloc(size)) != NULL)
+		record(ALLOC, p, 0, size);
+	return p;
+}
+
+void free(void *ptr)
+{
+	if (ptr == NULL || IN_ARENA(ptr))
+		return;
+	RESOLVED();
+	record(FREE, ptr, 0, 0);
+	real.free(ptr);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+	void *p;
+
+	if (resolving)
+		return arena_alloc(size);
+	RESOLVED();
+	if (IN_ARENA(ptr)) {
+		size_t left = arena + ARENA_SIZE - (char *)ptr;
+		if ((p = malloc(size)) != NULL)
+			memcpy(p, ptr, size < left ? size : left);
+		return p;
+	}
+	if (ptr == NULL) {
+		if ((p = real.realloc(ptr, size)) != NULL)
+			record(ALLOC, p, 0, size);
+		return p;
+	}
+	record(REALLOC, NULL, (uint64_t)ptr, size);
+	p = real.realloc(ptr, size);
+	record(MOVED, p, (uint64_t)ptr, size);
+	return p;
+}
+
+void *reallocarray(void *ptr, size_t nmemb, size_t size)
+{
+	size_t bytes;
+
+	if (__builtin_mul_overflow(nmemb, size, &bytes)) {
+		errno = ENOMEM;
+		return NULL;
+	}
+	return realloc(ptr, bytes);
+}
+
+void *calloc(size_t nmemb, size_t size)
+{
+	void *p;
+	size_t bytes;
+
+	if (resolving)
+		return __builtin_mul_overflow(nmemb, size, &bytes) ? NULL : arena_alloc(bytes);
+	RESOLVED();
+	if ((p = real.calloc(nmemb, size)) != NULL)
+		record(CALLOC, p, 0, nmemb * size);
+	return p;
+}
+
+void *memalign(size_t align, size_t size)
+{
+	void *p;
+
+	RESOLVED();
+	if ((p = real.memalign(align, size)) != NULL)
+		record(MEMALIGN, p, align, size);
+	return p;
+}
+
+int posix_memalign(void **memptr, size_t align, size_t size)
+{
+	int ret;
+
+	RESOLVED();
+	if ((ret = real.posix_memalign(memptr, align, size)) == 0)
+		record(MEMALIGN, *memptr, align, size);
+	return ret;
+}
+
+void *aligned_alloc(size_t align, size_t size)
+{
+	void *p;
+
+	RESOLVED();
+	if ((p = real.aligned_alloc(align, size)) != NULL)
+		record(MEMALIGN, p, align, size);
+	return p;
+}
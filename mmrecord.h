@@ -0,0 +1,31 @@
+/*
+ * mmrecord.h - raw records of the allocation recorder
+ *
+ * librecord.so (mmrecord.c) writes the requests of each thread it has
+ * seen to a file <prefix>.<pid>.<ring>.raw as an array of rec_t, in the
+ * order of their seq numbers, which are unique in the process. rec2rep
+ * merges the files on seq and turns the pointers into block ids.
+ *
+ * A realloc(p, size) of a live p makes two records of the same thread:
+ * REALLOC before the call, from which p may be handed out again, and
+ * MOVED after it, with the block returned, NULL if it failed or if
+ * size was 0 and p is freed. A realloc(NULL, size) is an ALLOC.
+ */
+#ifndef __MMRECORD_H_
+#define __MMRECORD_H_
+
+#include <stdint.h>
+
+#include "bintrace.h"
+
+#define MOVED BT_NUM_TYPES /* second record of a realloc */
+
+typedef struct {
+	uint64_t seq;   /* order of the request in the process */
+	uint64_t ptr;   /* block returned, or freed by FREE, 0 for REALLOC */
+	uint64_t arg;   /* old block of a REALLOC or MOVED, alignment of a MEMALIGN */
+	uint32_t size;  /* bytes asked for, nmemb * size for CALLOC */
+	uint32_t type;  /* ALLOC, FREE, REALLOC, MOVED, MEMALIGN or CALLOC */
+} rec_t;
+
+#endif /* __MMRECORD_H_ */
@@ -0,0 +1,349 @@
+/*
+ * mtdriver.c - Multithreaded replay benchmark for the mm malloc package
+ *
+ * Every thread replays the same trace file against the one shared heap,
+ * with its own array of blocks, so the threads only meet inside mm.c.
+ * The trace is run with 1, 2, 4, ... threads up to -t and the driver
+ * prints the total throughput and the speedup over a single thread.
+ * The trace may be a .rep file or a binary trace from rep2bin.
+ * mm.c must be built with -DMM_THREADS for this driver.
+ */
+#include <errno.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "mm.h"
+#include "memlib.h"
+#include "bintrace.h"
+
+/* Misc */
+#define MAXLINE     1024 /* max string size */
+
+/* Characterizes a single trace operation (allocator request), laid
+   out as a binary trace stores it, as in mdriver */
+typedef bt_op_t traceop_t;
+
+/* Holds the information for one trace file */
+typedef struct {
+	int num_ids;         /* number of alloc/realloc ids */
+	int num_ops;         /* number of distinct requests */
+	traceop_t *ops;      /* array of requests */
+} trace_t;
+
+/* The params of one replay thread */
+typedef struct {
+	pthread_t tid;
+	const trace_t *trace;
+	int rounds;          /* number of times to replay the trace */
+	char **blocks;       /* this thread's ptrs returned by malloc/realloc */
+} worker_t;
+
+static pthread_barrier_t start_barrier;
+
+static trace_t *read_trace(const char *filename);
+static void read_bintrace(trace_t *trace, FILE *tracefile, const char *filename);
+static void check_trace(const trace_t *trace, const char *filename);
+static void *replay(void *arg);
+static double run_threads(const trace_t *trace, int nthreads, int rounds);
+static void usage(void);
+static void unix_error(const char *fmt, ...)
+	__attribute__((format(printf, 1,2), noreturn));
+static void app_error(const char *fmt, ...)
+	__attribute__((format(printf, 1,2), noreturn));
+
+/**************
+ * Main routine
+ **************/
+int main(int argc, char **argv)
+{
+	int c;
+	char *tracefile = NULL;
+	int max_threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+	int rounds = 10;
+	double secs, base_kops = 0, kops;
+	trace_t *trace;
+
+	while ((c = getopt(argc, argv, "f:t:n:h")) != EOF) {
+		switch (c) {
+			case 'f': /* Trace file to replay */
+				tracefile = optarg;
+				break;
+			case 't': /* Largest number of threads */
+				max_threads = atoi(optarg);
+				break;
+			case 'n': /* Rounds of the trace per thread */
+				rounds = atoi(optarg);
+				break;
+			case 'h':
+				usage();
+				exit(0);
+			default:
+				usage();
+				exit(1);
+		}
+	}
+	if (tracefile == NULL || max_threads < 1 || rounds < 1) {
+		usage();
+		exit(1);
+	}
+
+	trace = read_trace(tracefile);
+	mem_init();
+
+	printf("%8s%12s%12s%9s\n", "threads", "secs", "Kops", "speedup");
+	for (int n = 1; ; n *= 2) {
+		if (n > max_threads)
+			n = max_threads;
+		secs = run_threads(trace, n, rounds);
+		kops = (double)n * rounds * trace->num_ops / 1e3 / secs;
+		if (n == 1)
+			base_kops = kops;
+		printf("%8d%12.6f%12.0f%8.2fx\n", n, secs, kops, kops / base_kops);
+		if (n == max_threads)
+			break;
+	}
+
+	mem_deinit();
+	exit(0);
+}
+
+/*
+ * run_threads - Reset the heap, replay the trace in nthreads threads
+ *     started together, and return the wall clock time in secs.
+ */
+static double run_threads(const trace_t *trace, int nthreads, int rounds)
+{
+	worker_t *workers;
+	struct timespec start, end;
+
+	mem_reset_brk();
+	if (mm_init() < 0)
+		app_error("mm_init failed in run_threads\n");
+
+	if ((workers = calloc(nthreads, sizeof(worker_t))) == NULL)
+		unix_error("calloc failed in run_threads");
+	pthread_barrier_init(&start_barrier, NULL, nthreads + 1);
+
+	for (int i = 0; i < nthreads; i++) {
+		workers[i].trace = trace;
+		workers[i].rounds = rounds;
+		if ((workers[i].blocks = calloc(trace->num_ids, sizeof(char *))) == NULL)
+			unix_error("calloc failed in run_threads");
+		if ((errno = pthread_create(&workers[i].tid, NULL, replay, &workers[i])))
+			unix_error("pthread_create failed in run_threads");
+	}
+
+	/* before the wait: once it returns, the workers may finish before
+	   this thread runs again */
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	pthread_barrier_wait(&start_barrier);
+	for (int i = 0; i < nthreads; i++)
+		pthread_join(workers[i].tid, NULL);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	for (int i = 0; i < nthreads; i++)
+		free(workers[i].blocks);
+	free(workers);
+	pthread_barrier_destroy(&start_barrier);
+
+	return (end.tv_sec - start.tv_sec) + 1e-9 * (end.tv_nsec - start.tv_nsec);
+}
+
+/*
+ * replay - Thread body, replays the trace rounds times.
+ */
+static void *replay(void *arg)
+{
+	worker_t *w = arg;
+	const trace_t *trace = w->trace;
+	char *p;
+
+	pthread_barrier_wait(&start_barrier);
+	for (int r = 0; r < w->rounds; r++) {
+		/* an id first given by a realloc starts from NULL every round */
+		memset(w->blocks, 0, trace->num_ids * sizeof(char *));
+		for (int i = 0; i < trace->num_ops; i++) {
+			int index = trace->ops[i].index;
+			switch (trace->ops[i].type) {
+				case ALLOC:
+					if ((p = mm_malloc(trace->ops[i].size)) == NULL)
+						app_error("mm_malloc failed in replay\n");
+					w->blocks[index] = p;
+					break;
+				case CALLOC:
+					if ((p = mm_calloc(1, trace->ops[i].size)) == NULL)
+						app_error("mm_calloc failed in replay\n");
+					w->blocks[index] = p;
+					break;
+				case MEMALIGN:
+					if ((p = mm_memalign(trace->ops[i].align, trace->ops[i].size)) == NULL)
+						app_error("mm_memalign failed in replay\n");
+					w->blocks[index] = p;
+					break;
+				case REALLOC:
+					p = mm_realloc(w->blocks[index], trace->ops[i].size);
+					if (p == NULL && trace->ops[i].size != 0)
+						app_error("mm_realloc failed in replay\n");
+					w->blocks[index] = p;
+					break;
+				case FREE:
+					mm_free(index < 0 ? NULL : w->blocks[index]);
+					break;
+			}
+		}
+	}
+	return NULL;
+}
+
+/*
+ * read_trace - read a trace file, text or binary, and store it in memory
+ */
+static trace_t *read_trace(const char *filename)
+{
+	FILE *tracefile;
+	trace_t *trace;
+	char type[MAXLINE];
+	int weight, ignore_ranges;
+	int index;
+	unsigned int size, align;
+	int op_index = 0;
+
+	if ((trace = (trace_t *) malloc(sizeof(trace_t))) == NULL)
+		unix_error("malloc 1 failed in read_trace");
+	if ((tracefile = fopen(filename, "r")) == NULL)
+		unix_error("Could not open %s in read_trace", filename);
+
+	if (ungetc(getc(tracefile), tracefile) == BT_MAGIC[0]) {
+		read_bintrace(trace, tracefile, filename);
+		fclose(tracefile);
+		check_trace(trace, filename);
+		return trace;
+	}
+
+	if (fscanf(tracefile, "%d %d %d %d", &weight, &trace->num_ids,
+				&trace->num_ops, &ignore_ranges) != 4 ||
+			trace->num_ids < 0 || trace->num_ids > BT_MAX_INDEX + 1 ||
+			trace->num_ops < 0)
+		app_error("%s: bad trace header\n", filename);
+	if ((trace->ops = malloc(trace->num_ops * sizeof(traceop_t))) == NULL)
+		unix_error("malloc 2 failed in read_trace");
+
+	while (op_index < trace->num_ops && fscanf(tracefile, "%s", type) != EOF) {
+		traceop_t *op = &trace->ops[op_index];
+		size = align = 0;
+		switch(type[0]) {
+			case 'a':
+			case 'r':
+			case 'c':
+				if (fscanf(tracefile, "%d %u", &index, &size) != 2)
+					app_error("%s: bad request %d\n", filename, op_index);
+				op->type = type[0] == 'a' ? ALLOC : type[0] == 'r' ? REALLOC : CALLOC;
+				break;
+			case 'm':
+				if (fscanf(tracefile, "%d %u %u", &index, &size, &align) != 3)
+					app_error("%s: bad request %d\n", filename, op_index);
+				op->type = MEMALIGN;
+				break;
+			case 'f':
+				if (fscanf(tracefile, "%d", &index) != 1)
+					app_error("%s: bad request %d\n", filename, op_index);
+				op->type = FREE;
+				break;
+			default:
+				app_error("Bogus type character (%c) in tracefile %s\n",
+						type[0], filename);
+		}
+		if (index < -1 || index >= trace->num_ids)
+			app_error("%s: block index %d of request %d is not below %d\n",
+					filename, index, op_index, trace->num_ids);
+		op->index = index;
+		op->size = size;
+		op->align = align;
+		op_index++;
+	}
+	fclose(tracefile);
+	trace->num_ops = op_index;
+	check_trace(trace, filename);
+	return trace;
+}
+
+/*
+ * read_bintrace - read the binary trace from tracefile, as rep2bin wrote it
+ */
+static void read_bintrace(trace_t *trace, FILE *tracefile, const char *filename)
+{
+	bt_header_t hdr;
+
+	if (fread(&hdr, sizeof(hdr), 1, tracefile) != 1)
+		app_error("%s: truncated binary trace\n", filename);
+	if (memcmp(hdr.magic, BT_MAGIC, BT_MAGIC_LEN) != 0 || hdr.version != BT_VERSION)
+		app_error("%s: not a version %d binary trace\n", filename, BT_VERSION);
+	if (hdr.num_ops < 0 || hdr.num_ids < 0 || hdr.ops_offset < sizeof(hdr) ||
+			fseek(tracefile, hdr.ops_offset, SEEK_SET) != 0)
+		app_error("%s: truncated binary trace\n", filename);
+	trace->num_ids = hdr.num_ids;
+	trace->num_ops = hdr.num_ops;
+	if ((trace->ops = malloc(trace->num_ops * sizeof(traceop_t))) == NULL)
+		unix_error("malloc 2 failed in read_trace");
+	if (fread(trace->ops, sizeof(traceop_t), trace->num_ops, tracefile) !=
+			(size_t)trace->num_ops)
+		app_error("%s: truncated binary trace\n", filename);
+}
+
+/*
+ * check_trace - every request must name a block of the trace, only
+ *     free may name none (-1), and a memalign needs a power of two
+ */
+static void check_trace(const trace_t *trace, const char *filename)
+{
+	int i;
+
+	for (i = 0; i < trace->num_ops; i++) {
+		const traceop_t *op = &trace->ops[i];
+		if (op->type >= BT_NUM_TYPES || op->index >= trace->num_ids || op->index < -1 ||
+				(op->index == -1 && op->type != FREE) ||
+				(op->type == MEMALIGN && (op->align == 0 || (op->align & (op->align - 1)) != 0)))
+			app_error("%s: bad request %d\n", filename, i);
+	}
+}
+
+/*
+ * usage - Explain the command line arguments
+ */
+static void usage(void)
+{
+	fprintf(stderr, "Usage: mtdriver [-h] -f <file> [-t <n>] [-n <n>]\n");
+	fprintf(stderr, "Options\n");
+	fprintf(stderr, "\t-f <file>  Use <file> as the trace file.\n");
+	fprintf(stderr, "\t-t <n>     Run with up to <n> threads (default: online cpus).\n");
+	fprintf(stderr, "\t-n <n>     Replay the trace <n> times per thread (default 10).\n");
+	fprintf(stderr, "\t-h         Print this message.\n");
+}
+
+/*
+ * app_error - Report an arbitrary application error
+ */
+void app_error(const char *fmt, ...) {
+	va_list ap;
+	va_start(ap, fmt);
+	vprintf(fmt, ap);
+	va_end(ap);
+	exit(1);
+}
+
+/*
+ * unix_error - Report the error and its errno.
+ */
+void unix_error(const char *fmt, ...) {
+	va_list ap;
+	va_start(ap, fmt);
+	vprintf(fmt, ap);
+	printf(": %s\n", strerror(errno));
+	va_end(ap);
+	exit(1);
+}
@@ -0,0 +1,124 @@
+/*
+ * perfctr.c - per trace performance counters from perf_event_open
+ *
+ * Counters count user space only, so that perf_event_paranoid 2 lets
+ * us have them, and are read with their enabled and running times so
+ * that a count the kernel had to multiplex is scaled up to the whole run.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#include "perfctr.h"
+
+#define CACHE_MISS(cache, op) \
+	((cache) | (PERF_COUNT_HW_CACHE_OP_##op << 8) | \
+	 (PERF_COUNT_HW_CACHE_RESULT_MISS << 16))
+
+/* The counters, each with a software event to count if it can't be had */
+static const struct {
+	const char *name;
+	uint32_t type;
+	uint64_t config;
+	const char *sw_name;   /* NULL if there is no fallback */
+	uint64_t sw_config;
+} events[] = {
+	{ "instr", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS,
+		"task ns", PERF_COUNT_SW_TASK_CLOCK },
+	{ "L1D miss", PERF_TYPE_HW_CACHE, CACHE_MISS(PERF_COUNT_HW_CACHE_L1D, READ),
+		NULL, 0 },
+	{ "LLC miss", PERF_TYPE_HW_CACHE, CACHE_MISS(PERF_COUNT_HW_CACHE_LL, READ),
+		NULL, 0 },
+	{ "dTLB miss", PERF_TYPE_HW_CACHE, CACHE_MISS(PERF_COUNT_HW_CACHE_DTLB, READ),
+		NULL, 0 },
+	{ "br miss", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES,
+		NULL, 0 },
+	{ "faults", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS,
+		NULL, 0 },
+};
+#define NUM_EVENTS ((int)(sizeof(events) / sizeof(events[0])))
+
+/*
+ * open_event - open one counter of this thread, return its fd or -1
+ */
+static int open_event(uint32_t type, uint64_t config)
+{
+	struct perf_event_attr attr;
+
+	memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.type = type;
+	attr.config = config;
+	attr.disabled = 1;
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+	attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+	return syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+/*
+ * perf_open - open every counter that the kernel has, or its fallback
+ */
+int perf_open(perf_t *perf)
+{
+	int i, fd;
+
+	perf->n = 0;
+	for (i = 0; i < NUM_EVENTS && perf->n < PERF_MAX; i++) {
+		const char *name = events[i].name;
+		if ((fd = open_event(events[i].type, events[i].config)) < 0 &&
+				events[i].sw_name != NULL) {
+			fd = open_event(PERF_TYPE_SOFTWARE, events[i].sw_config);
+			name = events[i].sw_name;
+		}
+		if (fd < 0)
+			continue;
+		perf->fd[perf->n] = fd;
+		perf->name[perf->n] = name;
+		perf->n++;
+	}
+	return perf->n;
+}
+
+/*
+ * perf_close - close the counters, keeping n and the names
+ */
+void perf_close(perf_t *perf)
+{
+	for (int i = 0; i < perf->n; i++) {
+		close(perf->fd[i]);
+		perf->fd[i] = -1;
+	}
+}
+
+/*
+ * perf_start - zero the counters and start counting
+ */
+void perf_start(perf_t *perf)
+{
+	for (int i = 0; i < perf->n; i++) {
+		ioctl(perf->fd[i], PERF_EVENT_IOC_RESET, 0);
+		ioctl(perf->fd[i], PERF_EVENT_IOC_ENABLE, 0);
+	}
+}
+
+/*
+ * perf_stop - stop counting and read each counter into values, scaled
+ *     to the whole run if it was multiplexed, -1 if it can't be read
+ */
+void perf_stop(perf_t *perf, double *values)
+{
+	uint64_t buf[3]; /* value, time enabled, time running */
+
+	for (int i = 0; i < perf->n; i++)
+		ioctl(perf->fd[i], PERF_EVENT_IOC_DISABLE, 0);
+	for (int i = 0; i < perf->n; i++) {
+		if (read(perf->fd[i], buf, sizeof(buf)) != sizeof(buf) || buf[2] == 0)
+			values[i] = -1;
+		else
+			values[i] = (double)buf[0] * buf[1] / buf[2];
+	}
+}
@@ -0,0 +1,32 @@
+/*
+ * perfctr.h - per trace performance counters from perf_event_open
+ *
+ * perf_open opens the counters of this process that the kernel has:
+ * instructions, L1D and LLC read misses, dTLB read misses and branch
+ * misses from the hardware, and page faults in software. A hardware
+ * counter that can't be opened, as in most VMs, is replaced by its
+ * software fallback if it has one, or left out.
+ */
+#ifndef __PERFCTR_H_
+#define __PERFCTR_H_
+
+#include <stdint.h>
+
+#define PERF_MAX 8 /* most counters open at once */
+
+typedef struct {
+	int n;                      /* number of counters open */
+	int fd[PERF_MAX];
+	const char *name[PERF_MAX]; /* short name of each, for column heads */
+} perf_t;
+
+/* Open the counters, disabled, return how many could be opened */
+int perf_open(perf_t *perf);
+/* Close them; n and the names stay for the column heads */
+void perf_close(perf_t *perf);
+
+/* Zero and enable the counters, then disable them and read them into values */
+void perf_start(perf_t *perf);
+void perf_stop(perf_t *perf, double *values);
+
+#endif /* __PERFCTR_H_ */
@@ -0,0 +1,388 @@
+/*
+ * rec2rep.c - Turn the files of the allocation recorder into a .rep trace
+ *
+ * The .raw files that librecord.so wrote for the threads of a process
+ * (see mmrecord.h) are merged on seq into one stream of requests, and
+ * each block address gets a block id while it is live. Ids are reused
+ * after a free, so num_ids is the most blocks live at once, and blocks
+ * still live at exit are left allocated, as the program left them.
+ *
+ * Threads race between the allocator and the recorder, so a stream can
+ * now and then free an address nobody has, or hand out one that is
+ * still live; the first is dropped and the second frees the old block
+ * first, so that the trace is always one the driver can replay.
+ */
+#include <errno.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "mmrecord.h"
+
+/* Misc */
+#define HDR_WIDTH   20   /* width of the padded header counts */
+#define NO_ID       UINT32_MAX
+
+/* One input file, with the record it is at */
+typedef struct {
+	FILE *fp;
+	rec_t rec;
+	uint32_t moving;     /* id of the block of its REALLOC until the MOVED, or NO_ID */
+} input_t;
+
+/* The live blocks, an open addressing table from address to id */
+typedef struct {
+	uint64_t ptr;        /* 0 for an empty slot, 1 for a deleted one */
+	uint32_t id;
+} slot_t;
+
+static slot_t *table;
+static uint64_t table_size, table_used; /* slots, and those not empty */
+static uint32_t *free_ids;
+static uint64_t nfree, max_free, num_ids;
+static uint64_t num_ops, dropped;
+static FILE *out;
+
+static void usage(void);
+static void unix_error(const char *fmt, ...)
+	__attribute__((format(printf, 1,2), noreturn));
+static void app_error(const char *fmt, ...)
+	__attribute__((format(printf, 1,2), noreturn));
+
+/*******************
+ * The live blocks
+ *******************/
+
+static inline uint64_t hash(uint64_t ptr)
+{
+	return (ptr * 0x9e3779b97f4a7c15ULL) >> 17;
+}
+
+/*
+ * lookup - the slot of ptr, or the empty slot where it would go
+ */
+static slot_t *lookup(uint64_t ptr)
+{
+	uint64_t i = hash(ptr) & (table_size - 1);
+	slot_t *tomb = NULL;
+
+	while (table[i].ptr != 0) {
+		if (table[i].ptr == ptr)
+			return &table[i];
+		if (table[i].ptr == 1 && tomb == NULL)
+			tomb = &table[i];
+		i = (i + 1) & (table_size - 1);
+	}
+	return tomb ? tomb : &table[i];
+}
+
+/*
+ * grow - rehash into a table twice the size, dropping deleted slots
+ */
+static void grow(void)
+{
+	slot_t *old = table;
+	uint64_t old_size = table_size;
+
+	table_size = table_size ? table_size * 2 : 1024;
+	if ((table = calloc(table_size, sizeof(slot_t))) == NULL)
+		unix_error("calloc failed in grow");
+	table_used = 0;
+	for (uint64_t i = 0; i < old_size; i++)
+		if (old[i].ptr > 1) {
+			*lookup(old[i].ptr) = old[i];
+			table_used++;
+		}
+	free(old);
+}
+
+/*
+ * id_of - the id of the live block at ptr, NO_ID if there is none;
+ *     0 and 1 mark empty and deleted slots, and are never live
+ */
+static uint32_t id_of(uint64_t ptr)
+{
+	slot_t *s;
+
+	if (ptr <= 1)
+		return NO_ID;
+	s = lookup(ptr);
+	return s->ptr == ptr ? s->id : NO_ID;
+}
+
+/*
+ * unmap - ptr is no longer live, return the id it had or NO_ID
+ */
+static uint32_t unmap(uint64_t ptr)
+{
+	slot_t *s;
+
+	if (ptr <= 1)
+		return NO_ID;
+	s = lookup(ptr);
+	if (s->ptr != ptr)
+		return NO_ID;
+	s->ptr = 1;
+	return s->id;
+}
+
+/*
+ * free_id - id may be given to a new block
+ */
+static void free_id(uint32_t id)
+{
+	if (nfree == max_free) {
+		max_free = max_free ? max_free * 2 : 1024;
+		if ((free_ids = realloc(free_ids, max_free * sizeof(uint32_t))) == NULL)
+			unix_error("realloc failed in free_id");
+	}
+	free_ids[nfree++] = id;
+}
+
+/*
+ * map - ptr is live as block id
+ */
+static void map(uint64_t ptr, uint32_t id)
+{
+	slot_t *s;
+
+	if (2 * (table_used + 1) > table_size)
+		grow();
+	s = lookup(ptr);
+	if (s->ptr == 0)
+		table_used++;
+	s->ptr = ptr;
+	s->id = id;
+}
+
+/*
+ * new_id - a free block id, reused if it can be
+ */
+static uint32_t new_id(void)
+{
+	return nfree > 0 ? free_ids[--nfree] : (uint32_t)num_ids++;
+}
+
+/*************
+ * Conversion
+ *************/
+
+/*
+ * emit_free - free the live block at ptr, if there is one
+ */
+static void emit_free(uint64_t ptr)
+{
+	uint32_t id = unmap(ptr);
+
+	if (id == NO_ID)
+		return;
+	fprintf(out, "f %u\n", id);
+	free_id(id);
+	num_ops++;
+}
+
+/*
+ * emit_alloc - a new block of size bytes at ptr, of request type
+ */
+static void emit_alloc(uint32_t type, uint64_t ptr, uint32_t size, uint64_t align)
+{
+	uint32_t id;
+
+	emit_free(ptr); /* the free of a block there was lost in a race */
+	id = new_id();
+	map(ptr, id);
+	if (size == 0) /* malloc(0) gave a block, the driver wants a size */
+		size = 1;
+	if (type == MEMALIGN && align > 0 && align <= UINT32_MAX && (align & (align - 1)) == 0)
+		fprintf(out, "m %u %u %llu\n", id, size, (unsigned long long)align);
+	else if (type == CALLOC)
+		fprintf(out, "c %u %u\n", id, size);
+	else
+		fprintf(out, "a %u %u\n", id, size);
+	num_ops++;
+}
+
+/*
+ * convert - write the .rep op for one record of in
+ */
+static void convert(input_t *in)
+{
+	const rec_t *r = &in->rec;
+	uint32_t id;
+
+	switch (r->type) {
+		case ALLOC:
+		case CALLOC:
+		case MEMALIGN:
+			emit_alloc(r->type, r->ptr, r->size, r->arg);
+			break;
+		case FREE:
+			if (id_of(r->ptr) == NO_ID)
+				dropped++;
+			emit_free(r->ptr);
+			break;
+		case REALLOC:
+			/* the old address is free from here, the block keeps its id */
+			in->moving = unmap(r->arg);
+			break;
+		case MOVED:
+			id = in->moving;
+			in->moving = NO_ID;
+			if (id == NO_ID) { /* a block we missed */
+				if (r->ptr != 0)
+					emit_alloc(ALLOC, r->ptr, r->size, 0);
+				break;
+			}
+			if (r->ptr == 0 && r->size > 0) { /* failed, the block stays */
+				map(r->arg, id);
+				break;
+			}
+			if (r->ptr == 0) { /* realloc(p, 0) freed it */
+				fprintf(out, "f %u\n", id);
+				free_id(id);
+				num_ops++;
+				break;
+			}
+			emit_free(r->ptr);
+			map(r->ptr, id);
+			fprintf(out, "r %u %u\n", id, r->size ? r->size : 1);
+			num_ops++;
+			break;
+		default:
+			app_error("bad record type %u\n", r->type);
+	}
+}
+
+/*
+ * next_rec - read the next record of in, return 0 at its end
+ */
+static int next_rec(input_t *in)
+{
+	if (in->fp == NULL)
+		return 0;
+	if (fread(&in->rec, sizeof(rec_t), 1, in->fp) == 1)
+		return 1;
+	fclose(in->fp);
+	in->fp = NULL;
+	return 0;
+}
+
+/**************
+ * Main routine
+ **************/
+int main(int argc, char **argv)
+{
+	int c, n, live;
+	input_t *in;
+	const char *outname = NULL;
+
+	while ((c = getopt(argc, argv, "o:h")) != EOF) {
+		switch (c) {
+			case 'o': /* Write the trace to a file */
+				outname = optarg;
+				break;
+			case 'h':
+				usage();
+				exit(0);
+			default:
+				usage();
+				exit(1);
+		}
+	}
+	if ((n = argc - optind) < 1) {
+		usage();
+		exit(1);
+	}
+
+	if ((in = calloc(n, sizeof(input_t))) == NULL)
+		unix_error("calloc failed in main");
+	if (outname == NULL) {
+		usage();
+		exit(1);
+	}
+	for (int i = 0; i < n; i++) {
+		if ((in[i].fp = fopen(argv[optind + i], "r")) == NULL)
+			unix_error("Could not open %s", argv[optind + i]);
+		in[i].moving = NO_ID;
+	}
+	if ((out = fopen(outname, "w")) == NULL)
+		unix_error("Could not open %s", outname);
+	if (fseek(out, 0, SEEK_SET) != 0)
+		app_error("rec2rep: %s can't seek, the header is written last\n", outname);
+	fprintf(out, "%*d\n%*d\n%*d\n%*d\n", HDR_WIDTH, 1, HDR_WIDTH, 0,
+			HDR_WIDTH, 0, HDR_WIDTH, 0);
+	grow();
+
+	/* merge the files on seq, each is in seq order already */
+	live = 0;
+	for (int i = 0; i < n; i++)
+		live += next_rec(&in[i]);
+	while (live > 0) {
+		int min = -1;
+		for (int i = 0; i < n; i++)
+			if (in[i].fp != NULL && (min < 0 || in[i].rec.seq < in[min].rec.seq))
+				min = i;
+		convert(&in[min]);
+		live -= !next_rec(&in[min]);
+	}
+
+	if (fseek(out, 0, SEEK_SET) != 0)
+		unix_error("fseek failed on the trace");
+	fprintf(out, "%*d\n%*llu\n%*llu\n%*d\n", HDR_WIDTH, 1,
+			HDR_WIDTH, (unsigned long long)num_ids,
+			HDR_WIDTH, (unsigned long long)num_ops, HDR_WIDTH, 0);
+	if (fflush(out) != 0 || ferror(out))
+		unix_error("write failed on the trace");
+	fclose(out);
+	fprintf(stderr, "rec2rep: %llu ops, %llu ids, %llu frees of unknown blocks dropped\n",
+			(unsigned long long)num_ops, (unsigned long long)num_ids,
+			(unsigned long long)dropped);
+	if (num_ops > INT32_MAX || num_ids > INT32_MAX)
+		fprintf(stderr, "rec2rep: %llu ops is more than mdriver reads\n",
+				(unsigned long long)num_ops);
+	free(table);
+	free(free_ids);
+	free(in);
+	exit(0);
+}
+
+/*
+ * usage - Explain the command line arguments
+ */
+static void usage(void)
+{
+	fprintf(stderr, "Usage: rec2rep [-h] -o <out.rep> <file.raw> ...\n");
+	fprintf(stderr, "Options\n");
+	fprintf(stderr, "\t-o <file>  Write the trace to <file>, which is required: the\n");
+	fprintf(stderr, "\t           header is filled in at the end, so it can't be a pipe.\n");
+	fprintf(stderr, "\t-h         Print this message.\n");
+	fprintf(stderr, "Record a program with\n");
+	fprintf(stderr, "\tMMRECORD=<prefix> LD_PRELOAD=./librecord.so <cmd>\n");
+	fprintf(stderr, "and give rec2rep the <prefix>.<pid>.*.raw files of one process.\n");
+}
+
+/*
+ * app_error - Report an arbitrary application error
+ */
+void app_error(const char *fmt, ...) {
+	va_list ap;
+	va_start(ap, fmt);
+	vfprintf(stderr, fmt, ap);
+	va_end(ap);
+	exit(1);
+}
+
+/*
+ * unix_error - Report the error and its errno.
+ */
+void unix_error(const char *fmt, ...) {
+	va_list ap;
+	va_start(ap, fmt);
+	vfprintf(stderr, fmt, ap);
+	fprintf(stderr, ": %s\n", strerror(errno));
+	va_end(ap);
+	exit(1);
+}
@@ -0,0 +1,247 @@
+/*
+ * rep2bin.c - Convert a .rep trace file to the binary trace format
+ *
+ * The binary trace (see bintrace.h) is what mdriver maps and replays
+ * without parsing, which keeps the load time of big traces out of the
+ * way. With -i the file also gets an index of the live bytes and blocks
+ * every <stride> ops.
+ */
+#include <errno.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "bintrace.h"
+
+/* Misc */
+#define MAXLINE     1024 /* max string size */
+
+static bt_op_t *read_rep(const char *filename, bt_header_t *hdr);
+static bt_index_t *build_index(bt_header_t *hdr, const bt_op_t *ops,
+		uint32_t stride);
+static void write_bin(const char *filename, bt_header_t *hdr,
+		const bt_op_t *ops, const bt_index_t *index);
+static void usage(void);
+static void unix_error(const char *fmt, ...)
+	__attribute__((format(printf, 1,2), noreturn));
+static void app_error(const char *fmt, ...)
+	__attribute__((format(printf, 1,2), noreturn));
+
+/**************
+ * Main routine
+ **************/
+int main(int argc, char **argv)
+{
+	int c;
+	int stride = 0;
+	bt_header_t hdr;
+	bt_op_t *ops;
+	bt_index_t *index = NULL;
+
+	while ((c = getopt(argc, argv, "i:h")) != EOF) {
+		switch (c) {
+			case 'i': /* Write an index entry every <stride> ops */
+				stride = atoi(optarg);
+				break;
+			case 'h':
+				usage();
+				exit(0);
+			default:
+				usage();
+				exit(1);
+		}
+	}
+	if (argc - optind != 2 || stride < 0) {
+		usage();
+		exit(1);
+	}
+
+	ops = read_rep(argv[optind], &hdr);
+	if (stride > 0)
+		index = build_index(&hdr, ops, stride);
+	write_bin(argv[optind + 1], &hdr, ops, index);
+
+	printf("%s: %d ops, %d ids, %u index entries\n", argv[optind + 1],
+			hdr.num_ops, hdr.num_ids, hdr.index_entries);
+	free(index);
+	free(ops);
+	exit(0);
+}
+
+/*
+ * read_rep - read a .rep trace file into an op array and fill in the
+ *     trace fields of the header
+ */
+static bt_op_t *read_rep(const char *filename, bt_header_t *hdr)
+{
+	FILE *tracefile;
+	bt_op_t *ops;
+	char type[MAXLINE];
+	unsigned int index, size, align;
+	int op_index = 0;
+
+	memset(hdr, 0, sizeof(*hdr));
+	memcpy(hdr->magic, BT_MAGIC, BT_MAGIC_LEN);
+	hdr->version = BT_VERSION;
+
+	if ((tracefile = fopen(filename, "r")) == NULL)
+		unix_error("Could not open %s in read_rep", filename);
+	if (fscanf(tracefile, "%d %d %d %d", &hdr->weight, &hdr->num_ids,
+				&hdr->num_ops, &hdr->ignore_ranges) != 4 || hdr->num_ops < 0)
+		app_error("%s: bad trace header\n", filename);
+	if (hdr->num_ids < 0 || hdr->num_ids > BT_MAX_INDEX + 1)
+		app_error("%s: %d block ids don't fit in a binary trace\n",
+				filename, hdr->num_ids);
+	if ((ops = calloc(hdr->num_ops, sizeof(bt_op_t))) == NULL)
+		unix_error("calloc failed in read_rep");
+
+	while (op_index < hdr->num_ops && fscanf(tracefile, "%s", type) != EOF) {
+		switch(type[0]) {
+			case 'a':
+			case 'r':
+			case 'c':
+				if (fscanf(tracefile, "%u %u", &index, &size) != 2)
+					app_error("%s: bad request %d\n", filename, op_index);
+				ops[op_index].type = type[0] == 'a' ? ALLOC : type[0] == 'r' ? REALLOC : CALLOC;
+				ops[op_index].size = size;
+				break;
+			case 'm':
+				if (fscanf(tracefile, "%u %u %u", &index, &size, &align) != 3 ||
+						align == 0 || (align & (align - 1)) != 0)
+					app_error("%s: bad request %d\n", filename, op_index);
+				ops[op_index].type = MEMALIGN;
+				ops[op_index].size = size;
+				ops[op_index].align = align;
+				break;
+			case 'f':
+				if (fscanf(tracefile, "%u", &index) != 1)
+					app_error("%s: bad request %d\n", filename, op_index);
+				ops[op_index].type = FREE;
+				break;
+			default:
+				app_error("Bogus type character (%c) in tracefile %s\n",
+						type[0], filename);
+		}
+		/* free(NULL) is written as index -1 in the .rep files */
+		if (((int)index < 0 || (int)index >= hdr->num_ids) &&
+				!(type[0] == 'f' && (int)index == -1))
+			app_error("%s: index %d of request %d out of range\n",
+					filename, (int)index, op_index);
+		ops[op_index].index = (int)index;
+		op_index++;
+	}
+	fclose(tracefile);
+	hdr->num_ops = op_index;
+	return ops;
+}
+
+/*
+ * build_index - compute the live payload bytes and blocks before every
+ *     stride'th op of the trace
+ */
+static bt_index_t *build_index(bt_header_t *hdr, const bt_op_t *ops,
+		uint32_t stride)
+{
+	bt_index_t *index;
+	uint32_t *sizes;
+	uint64_t live_bytes = 0;
+	uint32_t live_blocks = 0;
+	uint32_t n = (hdr->num_ops + stride - 1) / stride;
+
+	if ((index = calloc(n, sizeof(bt_index_t))) == NULL ||
+			(sizes = calloc(hdr->num_ids ? hdr->num_ids : 1, sizeof(uint32_t))) == NULL)
+		unix_error("calloc failed in build_index");
+
+	for (int i = 0; i < hdr->num_ops; i++) {
+		int id = ops[i].index;
+		if (i % stride == 0) {
+			index[i / stride].live_bytes = live_bytes;
+			index[i / stride].live_blocks = live_blocks;
+		}
+		switch (ops[i].type) {
+			case ALLOC:
+			case MEMALIGN:
+			case CALLOC:
+				live_bytes += ops[i].size;
+				live_blocks++;
+				sizes[id] = ops[i].size;
+				break;
+			case REALLOC:
+				live_bytes += (uint64_t)ops[i].size - sizes[id];
+				sizes[id] = ops[i].size;
+				break;
+			case FREE:
+				if (id < 0)
+					break;
+				live_bytes -= sizes[id];
+				live_blocks--;
+				sizes[id] = 0;
+				break;
+		}
+	}
+	free(sizes);
+
+	hdr->flags |= BT_HAS_INDEX;
+	hdr->index_stride = stride;
+	hdr->index_entries = n;
+	return index;
+}
+
+/*
+ * write_bin - write the header, the op stream and the index if there is one
+ */
+static void write_bin(const char *filename, bt_header_t *hdr,
+		const bt_op_t *ops, const bt_index_t *index)
+{
+	FILE *out;
+
+	hdr->ops_offset = sizeof(bt_header_t);
+	if (index)
+		hdr->index_offset = hdr->ops_offset + (uint64_t)hdr->num_ops * sizeof(bt_op_t);
+
+	if ((out = fopen(filename, "wb")) == NULL)
+		unix_error("Could not open %s in write_bin", filename);
+	if (fwrite(hdr, sizeof(*hdr), 1, out) != 1 ||
+			fwrite(ops, sizeof(bt_op_t), hdr->num_ops, out) != (size_t)hdr->num_ops ||
+			(index && fwrite(index, sizeof(bt_index_t), hdr->index_entries, out) !=
+			 hdr->index_entries))
+		unix_error("write failed on %s", filename);
+	if (fclose(out) != 0)
+		unix_error("close failed on %s", filename);
+}
+
+/*
+ * usage - Explain the command line arguments
+ */
+static void usage(void)
+{
+	fprintf(stderr, "Usage: rep2bin [-h] [-i <stride>] <in.rep> <out.bin>\n");
+	fprintf(stderr, "Options\n");
+	fprintf(stderr, "\t-i <stride>  Write an index entry every <stride> ops.\n");
+	fprintf(stderr, "\t-h           Print this message.\n");
+}
+
+/*
+ * app_error - Report an arbitrary application error
+ */
+void app_error(const char *fmt, ...) {
+	va_list ap;
+	va_start(ap, fmt);
+	vprintf(fmt, ap);
+	va_end(ap);
+	exit(1);
+}
+
+/*
+ * unix_error - Report the error and its errno.
+ */
+void unix_error(const char *fmt, ...) {
+	va_list ap;
+	va_start(ap, fmt);
+	vprintf(fmt, ap);
+	printf(": %s\n", strerror(errno));
+	va_end(ap);
+	exit(1);
+}
@@ -0,0 +1,502 @@
+/*
+ * repgen.c - Generate a synthetic .rep trace
+ *
+ * Blocks are allocated with a size and a lifetime, in ops, drawn from
+ * the distributions given, and freed when their lifetime is up. Some of
+ * them grow (or shrink) by realloc at even steps of their lifetime on
+ * the way. A trace can be cut into phases with a different workload
+ * each: the options before a -p <ops> describe a phase of that many
+ * ops, the next phase starts from a copy of them, and the options after
+ * the last -p describe the phase that runs to the end of the trace.
+ *
+ * Distributions are written as
+ *
+ *   <n>                       always n
+ *   uniform:<min>:<max>       uniform on [min, max]
+ *   lognormal:<mu>:<sigma>    exp of a normal(mu, sigma)
+ *   power:<alpha>:<min>:<max> Pareto with index alpha cut to [min, max]
+ *   exp:<mean>                exponential with that mean
+ *   hist:<file>               lines of "<value> <weight>" in file
+ *
+ * The ops are written as they are made, so a trace of billions of ops
+ * needs no more memory than its live blocks. The header counts are not
+ * known until the end: they are written padded and filled in after, or,
+ * if the output can't seek, found by a first run that writes nothing
+ * with the same seed. Block ids are reused after a free, so num_ids is
+ * the most blocks live at once.
+ */
+#include <errno.h>
+#include <math.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/* Misc */
+#define MAXLINE     1024 /* max string size */
+#define MAXPHASES   64   /* most phases in a trace */
+#define HDR_WIDTH   20   /* width of the padded header counts */
+
+typedef enum { D_CONST, D_UNIFORM, D_LOGNORMAL, D_POWER, D_EXP, D_HIST } dist_kind_t;
+
+/* A distribution of sizes or lifetimes */
+typedef struct {
+	dist_kind_t kind;
+	double a, b, c;      /* its parameters, in the order they are written */
+	int n;               /* D_HIST: number of values... */
+	double *values;      /* ... the values... */
+	double *cum;         /* ... and their cumulative weights */
+} dist_t;
+
+/* The workload of one phase */
+typedef struct {
+	uint64_t ops;        /* ops in the phase, 0 for the rest of the trace */
+	dist_t size;         /* payload bytes of a new block */
+	dist_t life;         /* ops from its malloc to its free */
+	double grow_prob;    /* chance that a block is reallocated... */
+	double grow_factor;  /* ... to this times its size... */
+	int grow_steps;      /* ... this many times over its life */
+} phase_t;
+
+/* A live block, kept in a heap on the op of its next realloc or free */
+typedef struct {
+	uint64_t when;
+	uint64_t step;       /* ops between its reallocs */
+	uint32_t id;
+	uint32_t size;
+	int steps;           /* reallocs still to come */
+	double factor;
+} block_t;
+
+/* What a run of the generator made */
+typedef struct {
+	uint64_t ops;
+	uint64_t ids;
+} counts_t;
+
+static phase_t phases[MAXPHASES];
+static int num_phases;
+
+static counts_t generate(FILE *out, uint64_t num_ops, uint64_t seed);
+static void parse_dist(dist_t *d, const char *spec);
+static void usage(void);
+static void unix_error(const char *fmt, ...)
+	__attribute__((format(printf, 1,2), noreturn));
+static void app_error(const char *fmt, ...)
+	__attribute__((format(printf, 1,2), noreturn));
+
+/**************
+ * Main routine
+ **************/
+int main(int argc, char **argv)
+{
+	int c;
+	uint64_t num_ops = 100000, seed = 1;
+	phase_t *ph = &phases[0];
+	FILE *out = stdout;
+	counts_t counts;
+
+	num_phases = 1;
+	parse_dist(&ph->size, "power:1.5:8:4096");
+	parse_dist(&ph->life, "exp:1000");
+	ph->grow_factor = 2;
+	ph->grow_steps = 4;
+
+	while ((c = getopt(argc, argv, "n:s:S:L:g:p:o:h")) != EOF) {
+		switch (c) {
+			case 'n': /* Ops in the trace */
+				num_ops = strtoull(optarg, NULL, 0);
+				break;
+			case 's': /* Seed of the random numbers */
+				seed = strtoull(optarg, NULL, 0);
+				break;
+			case 'S': /* Size distribution of the phase */
+				parse_dist(&ph->size, optarg);
+				break;
+			case 'L': /* Lifetime distribution of the phase */
+				parse_dist(&ph->life, optarg);
+				break;
+			case 'g': /* Realloc growth of the phase */
+				if (sscanf(optarg, "%lf:%lf:%d", &ph->grow_prob,
+							&ph->grow_factor, &ph->grow_steps) != 3 ||
+						ph->grow_prob < 0 || ph->grow_prob > 1 ||
+						ph->grow_factor <= 0 || ph->grow_steps < 1)
+					app_error("bad growth %s, want <prob>:<factor>:<steps>\n", optarg);
+				break;
+			case 'p': /* End the phase after this many ops */
+				if (num_phases == MAXPHASES)
+					app_error("more than %d phases\n", MAXPHASES);
+				if ((ph->ops = strtoull(optarg, NULL, 0)) == 0)
+					app_error("a phase needs at least one op\n");
+				phases[num_phases] = *ph;
+				ph = &phases[num_phases++];
+				ph->ops = 0;
+				break;
+			case 'o': /* Write the trace to a file */
+				if ((out = fopen(optarg, "w")) == NULL)
+					unix_error("Could not open %s", optarg);
+				break;
+			case 'h':
+				usage();
+				exit(0);
+			default:
+				usage();
+				exit(1);
+		}
+	}
+	if (argc != optind) {
+		usage();
+		exit(1);
+	}
+
+	if (fseek(out, 0, SEEK_SET) == 0) {
+		fprintf(out, "%*d\n%*d\n%*d\n%*d\n", HDR_WIDTH, 1, HDR_WIDTH, 0,
+				HDR_WIDTH, 0, HDR_WIDTH, 0);
+		counts = generate(out, num_ops, seed);
+		if (fseek(out, 0, SEEK_SET) != 0)
+			unix_error("fseek failed on the trace");
+		fprintf(out, "%*d\n%*llu\n%*llu\n%*d\n", HDR_WIDTH, 1,
+				HDR_WIDTH, (unsigned long long)counts.ids,
+				HDR_WIDTH, (unsigned long long)counts.ops, HDR_WIDTH, 0);
+	}
+	else {
+		/* a pipe: count first, then write the same trace */
+		counts = generate(NULL, num_ops, seed);
+		fprintf(out, "1\n%llu\n%llu\n0\n", (unsigned long long)counts.ids,
+				(unsigned long long)counts.ops);
+		generate(out, num_ops, seed);
+	}
+	if (fflush(out) != 0 || ferror(out))
+		unix_error("write failed on the trace");
+	if (out != stdout)
+		fclose(out);
+	if (counts.ops > INT32_MAX || counts.ids > INT32_MAX)
+		fprintf(stderr, "repgen: %llu ops is more than mdriver reads\n",
+				(unsigned long long)counts.ops);
+	exit(0);
+}
+
+/**********************************
+ * Random numbers and distributions
+ **********************************/
+
+static uint64_t rng[4]; /* xoshiro256** state */
+
+/*
+ * rng_seed - seed the generator, by splitmix64 of seed
+ */
+static void rng_seed(uint64_t seed)
+{
+	for (int i = 0; i < 4; i++) {
+		uint64_t z = (seed += 0x9e3779b97f4a7c15ULL);
+		z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+		z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+		rng[i] = z ^ (z >> 31);
+	}
+}
+
+static inline uint64_t rotl(uint64_t x, int k)
+{
+	return (x << k) | (x >> (64 - k));
+}
+
+/*
+ * rng_next - the next 64 random bits
+ */
+static uint64_t rng_next(void)
+{
+	uint64_t result = rotl(rng[1] * 5, 7) * 9;
+	uint64_t t = rng[1] << 17;
+
+	rng[2] ^= rng[0];
+	rng[3] ^= rng[1];
+	rng[1] ^= rng[2];
+	rng[0] ^= rng[3];
+	rng[2] ^= t;
+	rng[3] = rotl(rng[3], 45);
+	return result;
+}
+
+/*
+ * uniform - a double in (0, 1)
+ */
+static double uniform(void)
+{
+	return ((rng_next() >> 11) + 0.5) * (1.0 / 9007199254740992.0);
+}
+
+/*
+ * sample - draw a value of distribution d
+ */
+static double sample(const dist_t *d)
+{
+	switch (d->kind) {
+		case D_CONST:
+			return d->a;
+		case D_UNIFORM:
+			return floor(d->a + uniform() * (d->b - d->a + 1));
+		case D_LOGNORMAL:
+			return exp(d->a + d->b * sqrt(-2 * log(uniform())) * cos(2 * M_PI * uniform()));
+		case D_POWER: {
+			/* inverse of the Pareto CDF cut to [b, c] */
+			double cut = 1 - pow(d->b / d->c, d->a);
+			return d->b * pow(1 - uniform() * cut, -1 / d->a);
+		}
+		case D_EXP:
+			return -d->a * log(uniform());
+		case D_HIST: {
+			double u = uniform() * d->cum[d->n - 1];
+			int lo = 0, hi = d->n - 1;
+			while (lo < hi) {
+				int mid = (lo + hi) / 2;
+				if (d->cum[mid] < u)
+					lo = mid + 1;
+				else
+					hi = mid;
+			}
+			return d->values[lo];
+		}
+	}
+	return 0;
+}
+
+/*
+ * read_hist - read the "<value> <weight>" lines of filename into d
+ */
+static void read_hist(dist_t *d, const char *filename)
+{
+	FILE *f;
+	char line[MAXLINE];
+	double v, w, total = 0;
+	int max = 0;
+
+	if ((f = fopen(filename, "r")) == NULL)
+		unix_error("Could not open %s", filename);
+	d->n = 0;
+	while (fgets(line, sizeof(line), f)) {
+		if (line[0] == '#' || sscanf(line, "%lf %lf", &v, &w) != 2)
+			continue;
+		if (w < 0)
+			app_error("%s: negative weight\n", filename);
+		if (d->n == max) {
+			max = max ? 2 * max : 64;
+			if ((d->values = realloc(d->values, max * sizeof(double))) == NULL ||
+					(d->cum = realloc(d->cum, max * sizeof(double))) == NULL)
+				unix_error("realloc failed in read_hist");
+		}
+		total += w;
+		d->values[d->n] = v;
+		d->cum[d->n] = total;
+		d->n++;
+	}
+	fclose(f);
+	if (d->n == 0 || total <= 0)
+		app_error("%s: no values with weight\n", filename);
+}
+
+/*
+ * parse_dist - read a distribution as written in the usage into d
+ */
+static void parse_dist(dist_t *d, const char *spec)
+{
+	char *end;
+
+	memset(d, 0, sizeof(*d));
+	if (strncmp(spec, "hist:", 5) == 0) {
+		d->kind = D_HIST;
+		read_hist(d, spec + 5);
+		return;
+	}
+	if (sscanf(spec, "uniform:%lf:%lf", &d->a, &d->b) == 2 && d->a <= d->b)
+		d->kind = D_UNIFORM;
+	else if (sscanf(spec, "lognormal:%lf:%lf", &d->a, &d->b) == 2 && d->b >= 0)
+		d->kind = D_LOGNORMAL;
+	else if (sscanf(spec, "power:%lf:%lf:%lf", &d->a, &d->b, &d->c) == 3 &&
+			d->a > 0 && d->b > 0 && d->b <= d->c)
+		d->kind = D_POWER;
+	else if (sscanf(spec, "exp:%lf", &d->a) == 1 && d->a > 0)
+		d->kind = D_EXP;
+	else if ((d->a = strtod(spec, &end)) > 0 && *end == '\0')
+		d->kind = D_CONST;
+	else
+		app_error("bad distribution %s\n", spec);
+}
+
+/********************************
+ * The blocks waiting for an op
+ ********************************/
+
+static block_t *heap;
+static size_t heap_len, heap_max;
+
+static void heap_push(block_t b)
+{
+	size_t i;
+
+	if (heap_len == heap_max) {
+		heap_max = heap_max ? 2 * heap_max : 1024;
+		if ((heap = realloc(heap, heap_max * sizeof(block_t))) == NULL)
+			unix_error("realloc failed in heap_push");
+	}
+	for (i = heap_len++; i > 0 && heap[(i - 1) / 2].when > b.when; i = (i - 1) / 2)
+		heap[i] = heap[(i - 1) / 2];
+	heap[i] = b;
+}
+
+static block_t heap_pop(void)
+{
+	block_t top = heap[0], last = heap[--heap_len];
+	size_t i = 0, child;
+
+	while ((child = 2 * i + 1) < heap_len) {
+		if (child + 1 < heap_len && heap[child + 1].when < heap[child].when)
+			child++;
+		if (heap[child].when >= last.when)
+			break;
+		heap[i] = heap[child];
+		i = child;
+	}
+	heap[i] = last;
+	return top;
+}
+
+/*
+ * to_size - a sampled size as a payload size, at least 1 byte
+ */
+static uint32_t to_size(double x)
+{
+	if (!(x >= 1))
+		return 1;
+	if (x > UINT32_MAX)
+		return UINT32_MAX;
+	return (uint32_t)x;
+}
+
+/*
+ * generate - make the trace of num_ops ops from seed and write its ops
+ *     to out, or only count them if out is NULL
+ */
+static counts_t generate(FILE *out, uint64_t num_ops, uint64_t seed)
+{
+	counts_t counts = { 0, 0 };
+	uint32_t *free_ids = NULL;
+	size_t nfree = 0, max_free = 0;
+	uint64_t pending = 0;     /* reallocs and frees the live blocks still need */
+	uint64_t phase_end;
+	int p = 0;
+
+	rng_seed(seed);
+	heap_len = 0;
+	phase_end = phases[0].ops ? phases[0].ops : UINT64_MAX;
+
+	while (counts.ops < num_ops) {
+		uint64_t now = counts.ops;
+		const phase_t *ph;
+		block_t b;
+
+		while (now >= phase_end && p + 1 < num_phases) {
+			p++;
+			phase_end = phases[p].ops ? phase_end + phases[p].ops : UINT64_MAX;
+		}
+		ph = &phases[p];
+
+		if (heap_len == 0 || heap[0].when > now) {
+			/* a new block, if its ops fit in the trace */
+			int steps = uniform() < ph->grow_prob ? ph->grow_steps : 0;
+			if (now + pending + steps + 2 <= num_ops) {
+				b.size = to_size(sample(&ph->size));
+				b.when = now + (uint64_t)fmax(1, sample(&ph->life));
+				b.steps = steps;
+				b.factor = ph->grow_factor;
+				b.step = (b.when - now) / (steps + 1);
+				if (b.step == 0)
+					b.step = 1;
+				if (steps)
+					b.when = now + b.step;
+				if (nfree)
+					b.id = free_ids[--nfree];
+				else
+					b.id = counts.ids++;
+				if (out)
+					fprintf(out, "a %u %u\n", b.id, b.size);
+				counts.ops++;
+				pending += steps + 1;
+				heap_push(b);
+				continue;
+			}
+			if (heap_len == 0)
+				break;
+		}
+
+		/* the block whose realloc or free is due, or the next one */
+		b = heap_pop();
+		pending--;
+		if (b.steps) {
+			b.size = to_size(b.size * b.factor);
+			b.steps--;
+			b.when = (b.when > now ? b.when : now) + b.step;
+			if (out)
+				fprintf(out, "r %u %u\n", b.id, b.size);
+			heap_push(b);
+		}
+		else {
+			if (out)
+				fprintf(out, "f %u\n", b.id);
+			if (nfree == max_free) {
+				max_free = max_free ? 2 * max_free : 1024;
+				if ((free_ids = realloc(free_ids, max_free * sizeof(uint32_t))) == NULL)
+					unix_error("realloc failed in generate");
+			}
+			free_ids[nfree++] = b.id;
+		}
+		counts.ops++;
+	}
+	free(free_ids);
+	return counts;
+}
+
+/*
+ * usage - Explain the command line arguments
+ */
+static void usage(void)
+{
+	fprintf(stderr, "Usage: repgen [-h] [-n <ops>] [-s <seed>] [-o <out.rep>]\n");
+	fprintf(stderr, "              [-S <dist>] [-L <dist>] [-g <p>:<f>:<k>] [-p <ops> ...]\n");
+	fprintf(stderr, "Options\n");
+	fprintf(stderr, "\t-n <ops>       Ops in the trace, every block freed by the end.\n");
+	fprintf(stderr, "\t-s <seed>      Seed of the random numbers.\n");
+	fprintf(stderr, "\t-o <file>      Write the trace to <file>, not stdout.\n");
+	fprintf(stderr, "\t-S <dist>      Payload sizes in bytes.\n");
+	fprintf(stderr, "\t-L <dist>      Lifetimes in ops.\n");
+	fprintf(stderr, "\t-g <p>:<f>:<k> A block is reallocated with chance <p>, <k> times\n");
+	fprintf(stderr, "\t               over its life, to <f> times its size each time.\n");
+	fprintf(stderr, "\t-p <ops>       The options so far make a phase of <ops> ops.\n");
+	fprintf(stderr, "\t-h             Print this message.\n");
+	fprintf(stderr, "<dist> is <n>, uniform:<min>:<max>, lognormal:<mu>:<sigma>,\n");
+	fprintf(stderr, "power:<alpha>:<min>:<max>, exp:<mean> or hist:<file>.\n");
+}
+
+/*
+ * app_error - Report an arbitrary application error
+ */
+void app_error(const char *fmt, ...) {
+	va_list ap;
+	va_start(ap, fmt);
+	vfprintf(stderr, fmt, ap);
+	va_end(ap);
+	exit(1);
+}
+
+/*
+ * unix_error - Report the error and its errno.
+ */
+void unix_error(const char *fmt, ...) {
+	va_list ap;
+	va_start(ap, fmt);
+	vfprintf(stderr, fmt, ap);
+	fprintf(stderr, ": %s\n", strerror(errno));
+	va_end(ap);
+	exit(1);
+}
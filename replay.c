@@ -0,0 +1,278 @@
+/*
+ * replay.c - compile traces into segments and replay them
+ *
+ * The timed loop of the driver should cost as little as it can next to
+ * the allocator it times, so the ops are packed into the segments
+ * described in replay.h, and each allocator gets its own copy of the
+ * replay loop with its calls inlined into it.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "replay.h"
+#include "mm.h"
+
+/*
+ * op_words - words of one op of type t in a segment
+ */
+static int op_words(int t)
+{
+	return t == FREE ? 1 : t == MEMALIGN ? 3 : 2;
+}
+
+/*
+ * replay_compile - pack ops into segments, return NULL if out of memory
+ */
+replay_t *replay_compile(const bt_op_t *ops, int num_ops, int num_ids)
+{
+	replay_t *r;
+	size_t len = 0, pos = 0, head = 0;
+	int i, t, count = 0;
+
+	/* first pass: the length of the stream */
+	for (i = 0; i < num_ops; i++) {
+		if (count == 0 || ops[i].type != ops[i - 1].type || count == (int)REPLAY_MAX_COUNT) {
+			len++;
+			count = 0;
+		}
+		count++;
+		len += op_words(ops[i].type);
+	}
+
+	if ((r = calloc(1, sizeof(*r))) == NULL)
+		return NULL;
+	r->code = malloc((len ? len : 1) * sizeof(uint32_t));
+	r->slots = calloc(num_ids + 1, sizeof(void *));
+	r->sizes = calloc(num_ids + 1, sizeof(uint32_t));
+	if (r->code == NULL || r->slots == NULL || r->sizes == NULL) {
+		replay_free(r);
+		return NULL;
+	}
+	r->len = len;
+	r->num_ids = num_ids;
+	r->num_ops = num_ops;
+
+	/* second pass: fill it in, the header count last */
+	count = 0;
+	for (i = 0; i < num_ops; i++) {
+		t = ops[i].type;
+		if (count == 0 || t != (int)ops[i - 1].type || count == (int)REPLAY_MAX_COUNT) {
+			if (count)
+				r->code[head] |= count;
+			head = pos++;
+			r->code[head] = (uint32_t)t << REPLAY_TYPE_SHIFT;
+			r->segments++;
+			count = 0;
+		}
+		count++;
+		r->code[pos++] = ops[i].index + 1;
+		if (t != FREE)
+			r->code[pos++] = ops[i].size;
+		if (t == MEMALIGN)
+			r->code[pos++] = ops[i].align;
+	}
+	if (count)
+		r->code[head] |= count;
+	return r;
+}
+
+/*
+ * replay_free - free a compiled trace
+ */
+void replay_free(replay_t *r)
+{
+	if (r == NULL)
+		return;
+	free(r->code);
+	free(r->slots);
+	free(r->sizes);
+	free(r);
+}
+
+/*
+ * replay_set_touch - touch the first bytes of each payload from now on
+ */
+void replay_set_touch(replay_t *r, size_t bytes)
+{
+	r->touch = bytes;
+}
+
+typedef uint64_t __attribute__((may_alias)) word64_t;
+
+/*
+ * write_block - write the first n bytes of payload p, as the program
+ *     that asked for it would
+ */
+static inline void write_block(char *p, size_t n)
+{
+	memset(p, 0x5a, n);
+}
+
+/*
+ * read_block - read the first n bytes of payload p, return their sum
+ */
+static inline uint64_t read_block(const char *p, size_t n)
+{
+	uint64_t sum = 0;
+	size_t i;
+
+	for (i = 0; i + sizeof(word64_t) <= n; i += sizeof(word64_t))
+		sum += *(const word64_t *)(p + i);
+	for (; i < n; i++)
+		sum += (unsigned char)p[i];
+	return sum;
+}
+
+/*
+ * The allocator a replay loop calls, its functions known at compile time
+ */
+typedef struct {
+	void *(*malloc)(size_t size);
+	void (*free)(void *ptr);
+	void *(*realloc)(void *ptr, size_t size);
+	void *(*calloc)(size_t nmemb, size_t size);
+	void *(*memalign)(size_t align, size_t size);
+} allocator_t;
+
+/*
+ * replay - run the segments of r against allocator a, the loop that
+ *     replay_mm, replay_libc and replay_null each get a copy of, one
+ *     more with touching for the first two
+ */
+static inline __attribute__((always_inline))
+int replay(replay_t *r, const allocator_t a, const int touching)
+{
+	const uint32_t *pc = r->code, *end = r->code + r->len;
+	void **slots = r->slots;
+	uint32_t *sizes = r->sizes;
+	uint64_t sum = 0;
+	void *p;
+
+/* touch the new block p of size bytes in slot s, read the old one in slot s */
+#define TOUCH_NEW(s, size) \
+	if (touching) { \
+		sizes[s] = (size); \
+		write_block(p, sizes[s] < r->touch ? sizes[s] : r->touch); \
+	}
+#define TOUCH_OLD(s) \
+	if (touching) \
+		sum += read_block(slots[s], sizes[s] < r->touch ? sizes[s] : r->touch)
+
+	/* an id first given by a realloc reads its NULL slot as 0 bytes */
+	memset(slots, 0, (r->num_ids + 1) * sizeof(void *));
+	if (touching)
+		memset(sizes, 0, (r->num_ids + 1) * sizeof(uint32_t));
+	while (pc < end) {
+		uint32_t n = *pc & REPLAY_MAX_COUNT;
+		switch (*pc++ >> REPLAY_TYPE_SHIFT) {
+			case ALLOC:
+				for (; n; n--, pc += 2) {
+					if ((p = a.malloc(pc[1])) == NULL)
+						return -1;
+					slots[pc[0]] = p;
+					TOUCH_NEW(pc[0], pc[1]);
+				}
+				break;
+
+			case FREE:
+				for (; n; n--, pc++) {
+					TOUCH_OLD(pc[0]);
+					a.free(slots[pc[0]]);
+				}
+				break;
+
+			case REALLOC:
+				for (; n; n--, pc += 2) {
+					TOUCH_OLD(pc[0]);
+					if ((p = a.realloc(slots[pc[0]], pc[1])) == NULL && pc[1] != 0)
+						return -1;
+					slots[pc[0]] = p;
+					TOUCH_NEW(pc[0], pc[1]);
+				}
+				break;
+
+			case MEMALIGN:
+				for (; n; n--, pc += 3) {
+					if ((p = a.memalign(pc[2], pc[1])) == NULL)
+						return -1;
+					slots[pc[0]] = p;
+					TOUCH_NEW(pc[0], pc[1]);
+				}
+				break;
+
+			case CALLOC:
+				for (; n; n--, pc += 2) {
+					if ((p = a.calloc(1, pc[1])) == NULL)
+						return -1;
+					slots[pc[0]] = p;
+					TOUCH_NEW(pc[0], pc[1]);
+				}
+				break;
+		}
+	}
+#undef TOUCH_NEW
+#undef TOUCH_OLD
+	r->sink += sum;
+	return r->num_ops;
+}
+
+static const allocator_t mm_allocator = { mm_malloc, mm_free, mm_realloc,
+	mm_calloc, mm_memalign };
+static const allocator_t libc_allocator = { malloc, free, realloc,
+	calloc, aligned_alloc };
+
+int replay_mm(replay_t *r)
+{
+	return r->touch ? replay(r, mm_allocator, 1) : replay(r, mm_allocator, 0);
+}
+
+int replay_libc(replay_t *r)
+{
+	return r->touch ? replay(r, libc_allocator, 1) : replay(r, libc_allocator, 0);
+}
+
+/*
+ * The null allocator hands out one static block and frees nothing.
+ * noipa keeps gcc from seeing that, so the calls stay real calls.
+ */
+static char null_block[16];
+
+static __attribute__((noipa)) void *null_malloc(size_t size)
+{
+	(void)size;
+	return null_block;
+}
+
+static __attribute__((noipa)) void null_free(void *ptr)
+{
+	(void)ptr;
+}
+
+static __attribute__((noipa)) void *null_realloc(void *ptr, size_t size)
+{
+	(void)ptr;
+	(void)size;
+	return null_block;
+}
+
+static __attribute__((noipa)) void *null_calloc(size_t nmemb, size_t size)
+{
+	(void)nmemb;
+	(void)size;
+	return null_block;
+}
+
+static __attribute__((noipa)) void *null_memalign(size_t align, size_t size)
+{
+	(void)align;
+	(void)size;
+	return null_block;
+}
+
+int replay_null(replay_t *r)
+{
+	static const allocator_t null_allocator = { null_malloc, null_free,
+		null_realloc, null_calloc, null_memalign };
+	return replay(r, null_allocator, 0);
+}
@@ -0,0 +1,58 @@
+/*
+ * replay.h - compiled traces for timing the allocators
+ *
+ * replay_compile turns the ops of a trace into a stream of 32-bit words
+ * made of segments: a header word with the type in its top 3 bits and
+ * a count in the rest, then count ops of that type with only the words
+ * they need:
+ *
+ *   FREE              slot
+ *   ALLOC, CALLOC     slot, size
+ *   REALLOC           slot, size
+ *   MEMALIGN          slot, size, align
+ *
+ * A slot is the block index plus one, so that slot 0 always holds NULL
+ * and free(NULL) needs no test. Consecutive ops of one type make one
+ * segment, which the replay_* functions run as a loop of their own.
+ *
+ * With replay_set_touch, replay_mm and replay_libc also use the memory
+ * the way a program would: they write the payload, or the first touch
+ * bytes of it, when it is allocated, and read it back before it is
+ * freed or reallocated, so the cache and TLB misses of the allocator's
+ * placement count in the time.
+ */
+#ifndef __REPLAY_H_
+#define __REPLAY_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "bintrace.h"
+
+#define REPLAY_TYPE_SHIFT 29
+#define REPLAY_MAX_COUNT  ((1u << REPLAY_TYPE_SHIFT) - 1)
+
+typedef struct {
+	uint32_t *code;  /* the segments */
+	size_t len;      /* words in code */
+	void **slots;    /* block of each slot, num_ids + 1 of them */
+	uint32_t *sizes; /* and its payload size, kept when touching */
+	size_t touch;    /* bytes of each payload to touch, 0 for none */
+	uint64_t sink;   /* sum of the bytes read back */
+	int num_ids;
+	int num_ops;
+	int segments;    /* number of segments in code */
+} replay_t;
+
+replay_t *replay_compile(const bt_op_t *ops, int num_ops, int num_ids);
+void replay_free(replay_t *r);
+/* Touch the first bytes of every payload, SIZE_MAX for all, 0 for none */
+void replay_set_touch(replay_t *r, size_t bytes);
+
+/* Run the trace, return the op count, or -1 if a request failed */
+int replay_mm(replay_t *r);
+int replay_libc(replay_t *r);
+/* Run it against an allocator that does nothing, to time the loop alone */
+int replay_null(replay_t *r);
+
+#endif /* __REPLAY_H_ */
@@ -0,0 +1,467 @@
+/*
+ * repstat.c - Profile what a trace asks of the allocator
+ *
+ * For each trace, .rep or binary, repstat reports in one pass:
+ *
+ *   - the request sizes, binned on the free lists of mm.c (get_head),
+ *   - the lifetimes of blocks, in ops from their malloc to their free,
+ *   - the live payload bytes over the trace and their peak, the high
+ *     water mark that mdriver's utilization is taken against,
+ *   - the ratios of new to old size of the reallocs,
+ *   - the order of the frees: of the youngest live block (LIFO), of
+ *     the oldest (FIFO), or of one in between.
+ *
+ * The ops are read as they come, so the memory it needs is a few words
+ * per block id, whatever the length of the trace. The size bins are
+ * those of the mm.o it is linked with, so build it with the same TLSF
+ * or WIDE flags as the allocator being tuned.
+ */
+#include <errno.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "bintrace.h"
+#include "mm.h"
+
+/* Misc */
+#define MAXLINE     1024 /* max string size */
+#define LOG_BUCKETS 64   /* power of two buckets of the lifetimes */
+#define CURVE_ROWS  20   /* rows of the live bytes curve by default */
+#define CHUNK_OPS   4096 /* binary ops read at once */
+#define NONE        UINT32_MAX
+
+/* A block id, and its place among the live blocks in order of malloc */
+typedef struct {
+	uint64_t birth;      /* op that allocated it */
+	uint32_t size;       /* its payload bytes now */
+	uint32_t prev, next; /* the live blocks allocated before and after it */
+	int live;
+} block_t;
+
+/* Realloc ratios of new to old size, by upper bound */
+static const double ratio_bounds[] = { 0.5, 1.0, 1.0001, 1.5, 2.0, 4.0 };
+static const char *ratio_names[] = {
+	"< 0.5", "0.5 - 1", "1", "1 - 1.5", "1.5 - 2", "2 - 4", ">= 4" };
+#define RATIO_BUCKETS ((int)(sizeof(ratio_names) / sizeof(ratio_names[0])))
+
+/* What a trace was found to ask for */
+typedef struct {
+	uint64_t num_ops, num_ids;       /* from the header */
+	uint64_t op;                     /* ops seen so far */
+	block_t *blocks;
+	uint32_t oldest, youngest;       /* ends of the live list */
+	int nbins;
+	uint64_t *bin_allocs, *bin_reallocs;
+	uint32_t *bin_min, *bin_max;     /* smallest and largest size seen per bin */
+	uint64_t allocs, reallocs, frees;
+	uint64_t life[LOG_BUCKETS];      /* lifetimes in [2^i, 2^(i+1)) ops */
+	uint64_t never_freed;
+	uint64_t ratio[RATIO_BUCKETS];
+	double ratio_sum;
+	uint64_t lifo, fifo, other;      /* frees by place in the live list */
+	uint64_t live_bytes, live_blocks;
+	uint64_t hwm, hwm_op;            /* peak live bytes, and the op it was reached at */
+	uint64_t interval;               /* ops between rows of the curve */
+} profile_t;
+
+static uint64_t interval_flag;       /* -i: ops between rows of the curve */
+
+static void profile_trace(const char *filename);
+static void usage(void);
+static void unix_error(const char *fmt, ...)
+	__attribute__((format(printf, 1,2), noreturn));
+static void app_error(const char *fmt, ...)
+	__attribute__((format(printf, 1,2), noreturn));
+
+/**************
+ * Main routine
+ **************/
+int main(int argc, char **argv)
+{
+	int c;
+
+	while ((c = getopt(argc, argv, "i:h")) != EOF) {
+		switch (c) {
+			case 'i': /* Ops between two rows of the live bytes curve */
+				interval_flag = strtoull(optarg, NULL, 0);
+				break;
+			case 'h':
+				usage();
+				exit(0);
+			default:
+				usage();
+				exit(1);
+		}
+	}
+	if (argc == optind) {
+		usage();
+		exit(1);
+	}
+	for (int i = optind; i < argc; i++)
+		profile_trace(argv[i]);
+	exit(0);
+}
+
+/******************
+ * Taking the ops in
+ ******************/
+
+/*
+ * size_request - count a request for size bytes in its bin
+ */
+static void size_request(profile_t *p, uint32_t size, int realloc)
+{
+	int bin = mm_size_class(size);
+
+	if (realloc)
+		p->bin_reallocs[bin]++;
+	else
+		p->bin_allocs[bin]++;
+	if (size < p->bin_min[bin])
+		p->bin_min[bin] = size;
+	if (size > p->bin_max[bin])
+		p->bin_max[bin] = size;
+}
+
+/*
+ * block_of - the block of id, an error if the header has too few ids
+ */
+static block_t *block_of(profile_t *p, int id)
+{
+	if (id < 0 || (uint64_t)id >= p->num_ids)
+		app_error("op %llu: block id %d is not below num_ids %llu\n",
+				(unsigned long long)p->op, id, (unsigned long long)p->num_ids);
+	return &p->blocks[id];
+}
+
+/*
+ * live_add - id becomes the youngest live block, of size bytes
+ */
+static void live_add(profile_t *p, uint32_t id, uint32_t size)
+{
+	block_t *b = &p->blocks[id];
+
+	b->live = 1;
+	b->birth = p->op;
+	b->size = size;
+	b->prev = p->youngest;
+	b->next = NONE;
+	if (p->youngest != NONE)
+		p->blocks[p->youngest].next = id;
+	else
+		p->oldest = id;
+	p->youngest = id;
+	p->live_bytes += size;
+	p->live_blocks++;
+}
+
+/*
+ * live_remove - id is freed
+ */
+static void live_remove(profile_t *p, uint32_t id)
+{
+	block_t *b = &p->blocks[id];
+	uint64_t life = p->op - b->birth;
+
+	if (id == p->youngest)
+		p->lifo++;
+	else if (id == p->oldest)
+		p->fifo++;
+	else
+		p->other++;
+	p->life[life ? 63 - __builtin_clzll(life) : 0]++;
+
+	if (b->prev != NONE)
+		p->blocks[b->prev].next = b->next;
+	else
+		p->oldest = b->next;
+	if (b->next != NONE)
+		p->blocks[b->next].prev = b->prev;
+	else
+		p->youngest = b->prev;
+	b->live = 0;
+	p->live_bytes -= b->size;
+	p->live_blocks--;
+}
+
+/*
+ * print_row - a row of the live bytes curve
+ */
+static void print_row(const profile_t *p)
+{
+	printf("%14llu %16llu %12llu\n", (unsigned long long)p->op,
+			(unsigned long long)p->live_bytes, (unsigned long long)p->live_blocks);
+}
+
+/*
+ * take_op - account for one op of the trace
+ */
+static void take_op(profile_t *p, int type, int id, uint32_t size)
+{
+	block_t *b;
+
+	if (type == FREE && id < 0) /* free(NULL) */
+		goto done;
+	b = block_of(p, id);
+	switch (type) {
+		case ALLOC:
+		case CALLOC:
+		case MEMALIGN:
+			if (b->live) /* the driver would have two blocks, count the old one freed */
+				live_remove(p, id);
+			size_request(p, size, 0);
+			live_add(p, id, size);
+			p->allocs++;
+			break;
+		case REALLOC:
+			size_request(p, size, 1);
+			if (!b->live) { /* realloc(NULL) */
+				live_add(p, id, size);
+				p->reallocs++;
+				break;
+			}
+			if (b->size > 0) {
+				double r = (double)size / b->size;
+				int i = 0;
+				while (i < RATIO_BUCKETS - 1 && r >= ratio_bounds[i])
+					i++;
+				p->ratio[i]++;
+				p->ratio_sum += r;
+			}
+			p->live_bytes += (uint64_t)size - b->size;
+			b->size = size;
+			p->reallocs++;
+			break;
+		case FREE:
+			if (b->live)
+				live_remove(p, id);
+			p->frees++;
+			break;
+		default:
+			app_error("op %llu: bad type %d\n", (unsigned long long)p->op, type);
+	}
+	if (p->live_bytes > p->hwm) {
+		p->hwm = p->live_bytes;
+		p->hwm_op = p->op;
+	}
+done:
+	p->op++;
+	if (p->op % p->interval == 0)
+		print_row(p);
+}
+
+/*****************
+ * Reading a trace
+ *****************/
+
+/*
+ * read_rep - feed the ops of a .rep file, past its header, to take_op
+ */
+static void read_rep(profile_t *p, FILE *fp, const char *filename)
+{
+	char line[MAXLINE];
+	char type[MAXLINE];
+	int id;
+	unsigned int size, align;
+
+	while (p->op < p->num_ops && fgets(line, MAXLINE, fp) != NULL) {
+		size = align = 0;
+		if (sscanf(line, "%s %d %u %u", type, &id, &size, &align) < 2)
+			continue; /* a blank line */
+		switch (type[0]) {
+			case 'a': take_op(p, ALLOC, id, size); break;
+			case 'r': take_op(p, REALLOC, id, size); break;
+			case 'c': take_op(p, CALLOC, id, size); break;
+			case 'm': take_op(p, MEMALIGN, id, size); break;
+			case 'f': take_op(p, FREE, id, 0); break;
+			default:
+				app_error("Bogus type character (%c) in tracefile %s\n",
+						type[0], filename);
+		}
+	}
+}
+
+/*
+ * read_bin - feed the ops of a binary trace to take_op
+ */
+static void read_bin(profile_t *p, FILE *fp, const bt_header_t *hdr)
+{
+	static bt_op_t ops[CHUNK_OPS];
+	size_t n;
+
+	if (fseek(fp, hdr->ops_offset, SEEK_SET) != 0)
+		unix_error("fseek failed on the trace");
+	while (p->op < p->num_ops &&
+			(n = fread(ops, sizeof(bt_op_t), CHUNK_OPS, fp)) > 0)
+		for (size_t i = 0; i < n && p->op < p->num_ops; i++)
+			take_op(p, ops[i].type, ops[i].index, ops[i].size);
+}
+
+/*********
+ * Reports
+ *********/
+
+static double pct(uint64_t part, uint64_t whole)
+{
+	return whole ? 100.0 * part / whole : 0;
+}
+
+/*
+ * print_profile - everything but the curve, printed as the trace is read
+ */
+static void print_profile(const profile_t *p)
+{
+	uint64_t requests = p->allocs + p->reallocs, freed = 0, cum = 0, ratios = 0;
+	int last;
+
+	printf("\nSize classes (mm_size_class, %d free lists)\n", p->nbins);
+	printf("%5s %10s %10s %12s %12s %7s\n", "list", "min", "max", "allocs", "reallocs", "%req");
+	for (int i = 0; i < p->nbins; i++) {
+		if (p->bin_allocs[i] + p->bin_reallocs[i] == 0)
+			continue;
+		printf("%5d %10u %10u %12llu %12llu %6.1f%%\n", i, p->bin_min[i], p->bin_max[i],
+				(unsigned long long)p->bin_allocs[i],
+				(unsigned long long)p->bin_reallocs[i],
+				pct(p->bin_allocs[i] + p->bin_reallocs[i], requests));
+	}
+
+	for (int i = 0; i < LOG_BUCKETS; i++)
+		freed += p->life[i];
+	printf("\nLifetimes in ops (%llu blocks never freed)\n",
+			(unsigned long long)p->never_freed);
+	printf("%22s %12s %7s %7s\n", "ops", "frees", "%", "cum%");
+	for (last = LOG_BUCKETS - 1; last > 0 && p->life[last] == 0; last--)
+		;
+	for (int i = 0; i <= last; i++) {
+		cum += p->life[i];
+		printf("%10llu - %9llu %12llu %6.1f%% %6.1f%%\n",
+				i ? 1ULL << i : 0ULL, (2ULL << i) - 1,
+				(unsigned long long)p->life[i], pct(p->life[i], freed), pct(cum, freed));
+	}
+
+	for (int i = 0; i < RATIO_BUCKETS; i++)
+		ratios += p->ratio[i];
+	printf("\nRealloc ratios, new / old size (%llu reallocs, mean %.2f)\n",
+			(unsigned long long)ratios, ratios ? p->ratio_sum / ratios : 0);
+	for (int i = 0; ratios && i < RATIO_BUCKETS; i++)
+		printf("%10s %12llu %6.1f%%\n", ratio_names[i],
+				(unsigned long long)p->ratio[i], pct(p->ratio[i], ratios));
+
+	printf("\nFree order (%llu frees of live blocks)\n", (unsigned long long)freed);
+	printf("%10s %12llu %6.1f%%\n", "LIFO", (unsigned long long)p->lifo, pct(p->lifo, freed));
+	printf("%10s %12llu %6.1f%%\n", "FIFO", (unsigned long long)p->fifo, pct(p->fifo, freed));
+	printf("%10s %12llu %6.1f%%\n", "other", (unsigned long long)p->other, pct(p->other, freed));
+
+	printf("\nPeak live bytes %llu at op %llu, %llu bytes and %llu blocks live at the end\n",
+			(unsigned long long)p->hwm, (unsigned long long)p->hwm_op,
+			(unsigned long long)p->live_bytes, (unsigned long long)p->live_blocks);
+}
+
+/*
+ * profile_trace - read a trace once and print its profile
+ */
+static void profile_trace(const char *filename)
+{
+	FILE *fp;
+	profile_t p;
+	bt_header_t hdr;
+	unsigned long long num_ids, num_ops;
+	int binary;
+
+	if ((fp = fopen(filename, "r")) == NULL)
+		unix_error("Could not open %s", filename);
+	memset(&p, 0, sizeof(p));
+	binary = fread(&hdr, sizeof(hdr), 1, fp) == 1 &&
+		memcmp(hdr.magic, BT_MAGIC, BT_MAGIC_LEN - 1) == 0;
+	if (binary) {
+		if (memcmp(hdr.magic, BT_MAGIC, BT_MAGIC_LEN) != 0 || hdr.version != BT_VERSION)
+			app_error("%s: not a version %d binary trace\n", filename, BT_VERSION);
+		p.num_ids = hdr.num_ids;
+		p.num_ops = hdr.num_ops;
+	}
+	else {
+		rewind(fp);
+		if (fscanf(fp, "%*d %llu %llu %*d", &num_ids, &num_ops) != 2)
+			app_error("%s: bad trace header\n", filename);
+		p.num_ids = num_ids;
+		p.num_ops = num_ops;
+	}
+
+	p.nbins = mm_size_classes();
+	if ((p.blocks = calloc(p.num_ids ? p.num_ids : 1, sizeof(block_t))) == NULL ||
+			(p.bin_allocs = calloc(p.nbins, sizeof(uint64_t))) == NULL ||
+			(p.bin_reallocs = calloc(p.nbins, sizeof(uint64_t))) == NULL ||
+			(p.bin_min = malloc(p.nbins * sizeof(uint32_t))) == NULL ||
+			(p.bin_max = calloc(p.nbins, sizeof(uint32_t))) == NULL)
+		unix_error("malloc failed in profile_trace");
+	for (int i = 0; i < p.nbins; i++)
+		p.bin_min[i] = UINT32_MAX;
+	p.oldest = p.youngest = NONE;
+	p.interval = interval_flag ? interval_flag : p.num_ops / CURVE_ROWS;
+	if (p.interval == 0)
+		p.interval = 1;
+
+	printf("%s: %llu ops, %llu ids\n", filename,
+			(unsigned long long)p.num_ops, (unsigned long long)p.num_ids);
+	printf("\nLive payload over the trace\n");
+	printf("%14s %16s %12s\n", "op", "live bytes", "live blocks");
+	if (binary)
+		read_bin(&p, fp, &hdr);
+	else
+		read_rep(&p, fp, filename);
+	if (p.op % p.interval != 0)
+		print_row(&p);
+	if (p.op < p.num_ops)
+		fprintf(stderr, "%s: only %llu of %llu ops\n", filename,
+				(unsigned long long)p.op, (unsigned long long)p.num_ops);
+	p.never_freed = p.live_blocks;
+	print_profile(&p);
+	printf("\n");
+
+	fclose(fp);
+	free(p.blocks);
+	free(p.bin_allocs);
+	free(p.bin_reallocs);
+	free(p.bin_min);
+	free(p.bin_max);
+}
+
+/*
+ * usage - Explain the command line arguments
+ */
+static void usage(void)
+{
+	fprintf(stderr, "Usage: repstat [-h] [-i <ops>] <trace> ...\n");
+	fprintf(stderr, "Options\n");
+	fprintf(stderr, "\t-i <ops>   Ops between rows of the live bytes curve,\n");
+	fprintf(stderr, "\t           %d rows over the trace by default.\n", CURVE_ROWS);
+	fprintf(stderr, "\t-h         Print this message.\n");
+	fprintf(stderr, "A trace is a .rep file or a binary trace from rep2bin.\n");
+}
+
+/*
+ * app_error - Report an arbitrary application error
+ */
+void app_error(const char *fmt, ...) {
+	va_list ap;
+	va_start(ap, fmt);
+	vfprintf(stderr, fmt, ap);
+	va_end(ap);
+	exit(1);
+}
+
+/*
+ * unix_error - Report the error and its errno.
+ */
+void unix_error(const char *fmt, ...) {
+	va_list ap;
+	va_start(ap, fmt);
+	vfprintf(stderr, fmt, ap);
+	fprintf(stderr, ": %s\n", strerror(errno));
+	va_end(ap);
+	exit(1);
+}